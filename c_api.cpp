@@ -45,6 +45,7 @@ static void write(JSONWriter& writer, const RenderedLine& line) {
 		write(writer.write_member("spans"), line.spans);
 		write(writer.write_member("selections"), line.selections);
 		write(writer.write_member("cursors"), line.cursors);
+		write(writer.write_member("brackets"), line.brackets);
 	});
 }
 static void write(JSONWriter& writer, const Color& color) {
@@ -77,6 +78,7 @@ static void write(JSONWriter& writer, const Theme& theme) {
 struct PlatonEditor: Editor {
 	PlatonEditor() {}
 	PlatonEditor(const char* path): Editor(path) {}
+	PlatonEditor(const char* path, std::function<void(std::size_t, std::size_t)> progress): Editor(path, std::move(progress)) {}
 };
 
 PlatonEditor* platon_editor_new() {
@@ -87,14 +89,58 @@ PlatonEditor* platon_editor_new_from_file(const char* path) {
 	return new PlatonEditor(path);
 }
 
+PlatonEditor* platon_editor_open_async(const char* path, PlatonProgressCallback callback, void* user_data) {
+	return new PlatonEditor(path, [callback, user_data](std::size_t loaded, std::size_t total) {
+		if (callback) {
+			callback(user_data, loaded, total);
+		}
+	});
+}
+
+int platon_editor_poll_loading(PlatonEditor* editor, size_t* loaded, size_t* total) {
+	std::size_t loaded_bytes, total_bytes;
+	const bool loading = editor->poll_loading(loaded_bytes, total_bytes);
+	if (loaded) {
+		*loaded = loaded_bytes;
+	}
+	if (total) {
+		*total = total_bytes;
+	}
+	return loading;
+}
+
 void platon_editor_free(PlatonEditor* editor) {
 	delete editor;
 }
 
+int platon_editor_get_encoding(PlatonEditor* editor) {
+	return static_cast<int>(editor->get_encoding());
+}
+
 size_t platon_editor_get_total_lines(PlatonEditor* editor) {
 	return editor->get_total_lines();
 }
 
+size_t platon_editor_get_longest_line(PlatonEditor* editor) {
+	return editor->get_longest_line();
+}
+
+size_t platon_editor_get_index_for_utf16(PlatonEditor* editor, size_t column, size_t line) {
+	return editor->get_index_for_utf16(column, line);
+}
+
+void platon_editor_get_utf16_position(PlatonEditor* editor, size_t index, size_t* column, size_t* line) {
+	editor->get_utf16_position(index, *column, *line);
+}
+
+void platon_editor_get_indices_for_utf16(PlatonEditor* editor, const size_t* columns, const size_t* lines, size_t* indices, size_t count) {
+	editor->get_indices_for_utf16(columns, lines, indices, count);
+}
+
+void platon_editor_get_utf16_positions(PlatonEditor* editor, const size_t* indices, size_t* columns, size_t* lines, size_t count) {
+	editor->get_utf16_positions(indices, columns, lines, count);
+}
+
 const char* platon_editor_render(PlatonEditor* editor, size_t first_line, size_t last_line) {
 	static std::string json;
 	json.clear();
@@ -163,10 +209,34 @@ void platon_editor_move_to_end_of_line(PlatonEditor* editor, int extend_selectio
 	editor->move_to_end_of_line(extend_selection);
 }
 
+void platon_editor_move_to_matching_bracket(PlatonEditor* editor, int extend_selection) {
+	editor->move_to_matching_bracket(extend_selection);
+}
+
+int platon_editor_get_matching_bracket(PlatonEditor* editor, size_t index, size_t* match) {
+	return editor->get_matching_bracket(index, *match);
+}
+
+int platon_editor_get_enclosing_brackets(PlatonEditor* editor, size_t index, size_t* open, size_t* close) {
+	return editor->get_enclosing_brackets(index, *open, *close);
+}
+
 void platon_editor_select_all(PlatonEditor* editor) {
 	editor->select_all();
 }
 
+int platon_editor_find_next(PlatonEditor* editor, const char* text, int ignore_case) {
+	return editor->find_next(text, ignore_case);
+}
+
+int platon_editor_find_previous(PlatonEditor* editor, const char* text, int ignore_case) {
+	return editor->find_previous(text, ignore_case);
+}
+
+size_t platon_editor_select_all_occurrences(PlatonEditor* editor, const char* text, int ignore_case) {
+	return editor->select_all_occurrences(text, ignore_case);
+}
+
 const char* platon_editor_get_theme(const PlatonEditor* editor) {
 	static std::string json;
 	json.clear();
@@ -191,6 +261,6 @@ void platon_editor_paste(PlatonEditor* editor, const char* text) {
 	editor->paste(text);
 }
 
-void platon_editor_save(PlatonEditor* editor, const char* path) {
-	editor->save(path);
+int platon_editor_save(PlatonEditor* editor, const char* path) {
+	return editor->save(path);
 }
@@ -7,11 +7,25 @@ extern "C" {
 #endif
 
 typedef struct PlatonEditor PlatonEditor;
+// called from the loading thread whenever another part of the file has been loaded
+typedef void (*PlatonProgressCallback)(void* user_data, size_t loaded, size_t total);
 
 PlatonEditor* platon_editor_new(void);
 PlatonEditor* platon_editor_new_from_file(const char* path);
+// returns immediately and loads the file in the background, the editor can't be modified until the file is loaded
+PlatonEditor* platon_editor_open_async(const char* path, PlatonProgressCallback callback, void* user_data);
+// takes over the part of the file that has been loaded so far, returns nonzero while the file is still loading
+int platon_editor_poll_loading(PlatonEditor* editor, size_t* loaded, size_t* total);
 void platon_editor_free(PlatonEditor* editor);
+// 0 for valid utf-8, 1 if invalid utf-8 has been replaced with U+FFFD when the file was loaded, 2 for a binary file that is shown byte by byte and can't be modified
+int platon_editor_get_encoding(PlatonEditor* editor);
 size_t platon_editor_get_total_lines(PlatonEditor* editor);
+size_t platon_editor_get_longest_line(PlatonEditor* editor);
+// convert between byte indices and language server positions, whose columns count utf-16 code units
+size_t platon_editor_get_index_for_utf16(PlatonEditor* editor, size_t column, size_t line);
+void platon_editor_get_utf16_position(PlatonEditor* editor, size_t index, size_t* column, size_t* line);
+void platon_editor_get_indices_for_utf16(PlatonEditor* editor, const size_t* columns, const size_t* lines, size_t* indices, size_t count);
+void platon_editor_get_utf16_positions(PlatonEditor* editor, const size_t* indices, size_t* columns, size_t* lines, size_t count);
 const char* platon_editor_render(PlatonEditor* editor, size_t first_line, size_t last_line);
 void platon_editor_insert_text(PlatonEditor* editor, const char* text);
 void platon_editor_insert_newline(PlatonEditor* editor);
@@ -28,12 +42,22 @@ void platon_editor_move_to_beginning_of_word(PlatonEditor* editor, int extend_se
 void platon_editor_move_to_end_of_word(PlatonEditor* editor, int extend_selection);
 void platon_editor_move_to_beginning_of_line(PlatonEditor* editor, int extend_selection);
 void platon_editor_move_to_end_of_line(PlatonEditor* editor, int extend_selection);
+void platon_editor_move_to_matching_bracket(PlatonEditor* editor, int extend_selection);
+// return nonzero if the bracket at index has a match, or if there is a pair of brackets around index
+int platon_editor_get_matching_bracket(PlatonEditor* editor, size_t index, size_t* match);
+int platon_editor_get_enclosing_brackets(PlatonEditor* editor, size_t index, size_t* open, size_t* close);
 void platon_editor_select_all(PlatonEditor* editor);
+// select the next or previous match of text after or before the last selection, wrapping around, ignore_case only applies to ascii letters, returns 0 if there is no match
+int platon_editor_find_next(PlatonEditor* editor, const char* text, int ignore_case);
+int platon_editor_find_previous(PlatonEditor* editor, const char* text, int ignore_case);
+// select every match of text and return the number of matches, the selections are unchanged if there is none
+size_t platon_editor_select_all_occurrences(PlatonEditor* editor, const char* text, int ignore_case);
 const char* platon_editor_get_theme(const PlatonEditor* editor);
 const char* platon_editor_copy(const PlatonEditor* editor);
 const char* platon_editor_cut(PlatonEditor* editor);
 void platon_editor_paste(PlatonEditor* editor, const char* text);
-void platon_editor_save(PlatonEditor* editor, const char* path);
+// returns 0 if the file couldn't be written, in which case it is left unchanged
+int platon_editor_save(PlatonEditor* editor, const char* path);
 
 #ifdef __cplusplus
 }
@@ -4,31 +4,357 @@
 #include "tree.hpp"
 #include "prism/prism.hpp"
 #include <vector>
+#include <string>
+#include <cstring>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <bitset>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 class TextBuffer final: public Input {
+public:
+	// the summaries and the comps that find positions by them, which tests and benchmarks use as well
 	struct Info {
 		using T = char;
-		// these sizes are tuned for a node size of 128 bytes
-		static constexpr std::size_t LEAF_SIZE = 80;
+		// leaves are tuned for a node size of 384 bytes, inner nodes also hold the summaries of their children and fill 19 cache lines
+		static constexpr std::size_t LEAF_SIZE = 288;
 		static constexpr std::size_t INODE_SIZE = 12;
 		std::size_t bytes;
 		std::size_t codepoints;
 		std::size_t newlines;
-		constexpr Info(std::size_t bytes, std::size_t codepoints, std::size_t newlines): bytes(bytes), codepoints(codepoints), newlines(newlines) {}
-		constexpr Info(): bytes(0), codepoints(0), newlines(0) {}
-		constexpr Info(char c): bytes(1), codepoints((c & 0xC0) != 0x80), newlines(c == '\n') {}
+		// the number of codepoints after the last newline
+		std::size_t column;
+		// the number of codepoints before the first newline, or of everything if there is none
+		std::size_t first_line;
+		// the number of codepoints of the longest line that ends with a newline in here, the first line only counts from the start
+		std::size_t longest_line;
+		// the number of utf-16 code units, codepoints outside the basic multilingual plane take two of them
+		std::size_t utf16_units;
+		// the number of utf-16 code units after the last newline
+		std::size_t utf16_column;
+		// the number of positions at which the text is not valid utf-8, see is_utf8_error, only positions with 3 bytes before them in here count
+		std::size_t utf8_errors;
+		// the first 3 bytes and the last 3 bytes, each with the outermost byte in the lowest bits, so that the positions next to a boundary can be checked when summaries are added
+		std::uint32_t head;
+		std::uint32_t tail;
+		constexpr Info(std::size_t bytes, std::size_t codepoints, std::size_t newlines, std::size_t column, std::size_t first_line, std::size_t longest_line, std::size_t utf16_units, std::size_t utf16_column): bytes(bytes), codepoints(codepoints), newlines(newlines), column(column), first_line(first_line), longest_line(longest_line), utf16_units(utf16_units), utf16_column(utf16_column), utf8_errors(0), head(0), tail(0) {}
+		constexpr Info(): bytes(0), codepoints(0), newlines(0), column(0), first_line(0), longest_line(0), utf16_units(0), utf16_column(0), utf8_errors(0), head(0), tail(0) {}
+		constexpr Info(char c): bytes(1), codepoints((c & 0xC0) != 0x80), newlines(c == '\n'), column((c & 0xC0) != 0x80 && c != '\n'), first_line(column), longest_line(0), utf16_units(codepoints + ((c & 0xF0) == 0xF0)), utf16_column(c != '\n' ? utf16_units : 0), utf8_errors(0), head(static_cast<unsigned char>(c)), tail(static_cast<unsigned char>(c)) {}
+		static constexpr bool is_utf8_error(unsigned char p3, unsigned char p2, unsigned char p1, unsigned char c) {
+			// whether the byte c after the bytes p3, p2 and p1 makes the text invalid, every invalid text has at least one such position or ends in the middle of a sequence
+			const bool continuation = (c & 0xC0) == 0x80;
+			const bool expected = p1 >= 0xC0 || p2 >= 0xE0 || p3 >= 0xF0;
+			if (continuation != expected || c >= 0xF5 || c == 0xC0 || c == 0xC1) {
+				return true;
+			}
+			// overlong sequences, surrogates and codepoints above U+10FFFF
+			return (p1 == 0xE0 && continuation && c < 0xA0) || (p1 == 0xED && continuation && c >= 0xA0) || (p1 == 0xF0 && continuation && c < 0x90) || (p1 == 0xF4 && continuation && c >= 0x90);
+		}
+		static constexpr std::size_t get_utf8_errors(const Info& a, const Info& b) {
+			// the errors at the first positions of b that only have all 3 bytes before them once a is prepended
+			if (((a.tail | b.head) & 0x808080) == 0) {
+				return 0;
+			}
+			unsigned char bytes[6] = {static_cast<unsigned char>(a.tail >> 16), static_cast<unsigned char>(a.tail >> 8), static_cast<unsigned char>(a.tail), static_cast<unsigned char>(b.head), static_cast<unsigned char>(b.head >> 8), static_cast<unsigned char>(b.head >> 16)};
+			std::size_t errors = 0;
+			for (std::size_t j = 0; j < 3 && j < b.bytes; ++j) {
+				if (a.bytes + j >= 3 && is_utf8_error(bytes[j], bytes[j + 1], bytes[j + 2], bytes[j + 3])) {
+					++errors;
+				}
+			}
+			return errors;
+		}
 		constexpr Info operator +(const Info& info) const {
-			return Info(bytes + info.bytes, codepoints + info.codepoints, newlines + info.newlines);
+			Info result(
+				bytes + info.bytes,
+				codepoints + info.codepoints,
+				newlines + info.newlines,
+				info.newlines > 0 ? info.column : column + info.column,
+				newlines > 0 ? first_line : column + info.first_line,
+				// the line that spans the boundary ends in info if info has a newline
+				std::max(std::max(longest_line, info.longest_line), info.newlines > 0 ? column + info.first_line : 0),
+				utf16_units + info.utf16_units,
+				info.newlines > 0 ? info.utf16_column : utf16_column + info.utf16_column
+			);
+			result.utf8_errors = utf8_errors + info.utf8_errors + get_utf8_errors(*this, info);
+			result.head = bytes >= 3 ? head : (head | info.head << (8 * bytes)) & 0xFFFFFF;
+			result.tail = info.bytes >= 3 ? info.tail : (tail << (8 * info.bytes) | info.tail) & 0xFFFFFF;
+			return result;
+		}
+		constexpr bool operator ==(const Info& info) const {
+			return bytes == info.bytes && codepoints == info.codepoints && newlines == info.newlines && column == info.column && first_line == info.first_line && longest_line == info.longest_line && utf16_units == info.utf16_units && utf16_column == info.utf16_column && utf8_errors == info.utf8_errors && head == info.head && tail == info.tail;
+		}
+		static void add_block(std::uint32_t continuation_mask, std::uint32_t four_byte_mask, std::uint32_t newline_mask, std::uint32_t block_mask, Info& info) {
+			// add a block of up to 32 bytes given as bit masks
+			const std::uint32_t codepoint_mask = block_mask & ~continuation_mask;
+			info.bytes += std::bitset<32>(block_mask).count();
+			info.codepoints += std::bitset<32>(codepoint_mask).count();
+			info.utf16_units += std::bitset<32>(codepoint_mask).count() + std::bitset<32>(four_byte_mask & block_mask).count();
+			if (newline_mask) {
+				// measure every line that ends in this block, the first one continues the current column
+				if (info.newlines == 0) {
+					info.first_line = info.column + std::bitset<32>(codepoint_mask & ((newline_mask & ~(newline_mask - 1)) - 1)).count();
+				}
+				info.newlines += std::bitset<32>(newline_mask).count();
+				std::size_t line = info.column;
+				std::uint32_t done_mask = 0;
+				for (; newline_mask; newline_mask &= newline_mask - 1) {
+					const std::uint32_t end_mask = (newline_mask & ~(newline_mask - 1)) - 1;
+					line += std::bitset<32>(codepoint_mask & end_mask & ~done_mask).count();
+					info.longest_line = std::max(info.longest_line, line);
+					done_mask = end_mask | (end_mask + 1);
+					line = 0;
+				}
+				// only the codepoints after the last newline count for the column
+				info.column = std::bitset<32>(codepoint_mask & ~done_mask).count();
+				info.utf16_column = info.column + std::bitset<32>(four_byte_mask & block_mask & ~done_mask).count();
+			}
+			else {
+				info.column += std::bitset<32>(codepoint_mask).count();
+				info.utf16_column += std::bitset<32>(codepoint_mask).count() + std::bitset<32>(four_byte_mask & block_mask).count();
+				if (info.newlines == 0) {
+					info.first_line = info.column;
+				}
+			}
+		}
+		struct Utf8Masks {
+			// the bytes of a block that is validated at once, the signed comparisons below are used to find them
+			std::uint32_t continuation;
+			// lead bytes of sequences of at least 2, 3 and 4 bytes
+			std::uint32_t lead2;
+			std::uint32_t lead3;
+			std::uint32_t lead4;
+			// bytes that never occur in utf-8
+			std::uint32_t invalid;
+			// continuation bytes below 0xA0 and below 0x90, which are not allowed after some lead bytes
+			std::uint32_t below_a0;
+			std::uint32_t below_90;
+			std::uint32_t e0;
+			std::uint32_t ed;
+			std::uint32_t f0;
+			std::uint32_t f4;
+		};
+#if defined(__AVX2__)
+		static Utf8Masks get_utf8_masks(__m256i v, std::uint32_t continuation_mask, std::uint32_t sign_mask) {
+			Utf8Masks masks;
+			masks.continuation = continuation_mask;
+			masks.lead2 = _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-65))) & sign_mask;
+			masks.lead3 = _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-33))) & sign_mask;
+			masks.lead4 = _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-17))) & sign_mask;
+			// 0xF5 and above, 0xC0 and 0xC1
+			masks.invalid = (_mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-12))) & sign_mask) | _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(v, _mm256_set1_epi8(-2)), _mm256_set1_epi8(-64)));
+			masks.below_a0 = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-96), v));
+			masks.below_90 = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-112), v));
+			masks.e0 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(-32)));
+			masks.ed = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(-19)));
+			masks.f0 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(-16)));
+			masks.f4 = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(-12)));
+			return masks;
+		}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+		static Utf8Masks get_utf8_masks(__m128i v, std::uint32_t continuation_mask, std::uint32_t sign_mask) {
+			Utf8Masks masks;
+			masks.continuation = continuation_mask;
+			masks.lead2 = _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(-65))) & sign_mask;
+			masks.lead3 = _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(-33))) & sign_mask;
+			masks.lead4 = _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(-17))) & sign_mask;
+			masks.invalid = (_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(-12))) & sign_mask) | _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8(-2)), _mm_set1_epi8(-64)));
+			masks.below_a0 = _mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8(-96)));
+			masks.below_90 = _mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8(-112)));
+			masks.e0 = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(-32)));
+			masks.ed = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(-19)));
+			masks.f0 = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(-16)));
+			masks.f4 = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(-12)));
+			return masks;
+		}
+#endif
+		static std::uint32_t get_utf8_error_mask(const Utf8Masks& masks, std::size_t width, std::uint32_t& carry) {
+			// the positions of a block of width bytes at which is_utf8_error is true
+			// the lowest 3 bits of carry are the positions of the next block that must be continuation bytes, the next 4 bits whether the last byte was 0xE0, 0xED, 0xF0 or 0xF4
+			const std::uint32_t block_mask = width == 32 ? 0xFFFFFFFF : (1u << width) - 1;
+			const std::uint32_t expected = (masks.lead2 << 1 | masks.lead3 << 2 | masks.lead4 << 3 | (carry & 7)) & block_mask;
+			const std::uint32_t after_e0 = masks.e0 << 1 | (carry >> 3 & 1);
+			const std::uint32_t after_ed = masks.ed << 1 | (carry >> 4 & 1);
+			const std::uint32_t after_f0 = masks.f0 << 1 | (carry >> 5 & 1);
+			const std::uint32_t after_f4 = masks.f4 << 1 | (carry >> 6 & 1);
+			const std::uint32_t last = static_cast<std::uint32_t>(width - 1);
+			carry = ((masks.lead2 >> last | masks.lead3 >> (last - 1) | masks.lead4 >> (last - 2)) & 7) | (masks.e0 >> last) << 3 | (masks.ed >> last) << 4 | (masks.f0 >> last) << 5 | (masks.f4 >> last) << 6;
+			return (masks.continuation ^ expected) | masks.invalid | (after_e0 & masks.below_a0) | (after_ed & masks.continuation & ~masks.below_a0) | (after_f0 & masks.below_90) | (after_f4 & masks.continuation & ~masks.below_90);
+		}
+		static Info get_info(const char* data, std::size_t size) {
+			// summarize a whole leaf at once
+			Info info;
+			std::size_t i = 0;
+			std::uint32_t utf8_carry = 0;
+			// the first 3 positions of the leaf are only checked when it is added to what comes before it
+			std::uint32_t utf8_first_mask = ~7u;
+#if defined(__AVX2__)
+			for (; i + 32 <= size; i += 32) {
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				// continuation bytes are 0x80 to 0xBF, which is less than -64 as a signed char
+				const std::uint32_t continuation_mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-64), v));
+				// lead bytes of 4 byte sequences are 0xF0 and above, which is negative and greater than -17
+				const std::uint32_t four_byte_mask = _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(-17))) & _mm256_movemask_epi8(v);
+				const std::uint32_t newline_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+				add_block(continuation_mask, four_byte_mask, newline_mask, 0xFFFFFFFF, info);
+				// blocks of ascii after complete sequences are always valid
+				const std::uint32_t sign_mask = _mm256_movemask_epi8(v);
+				if (sign_mask | utf8_carry) {
+					info.utf8_errors += std::bitset<32>(get_utf8_error_mask(get_utf8_masks(v, continuation_mask, sign_mask), 32, utf8_carry) & utf8_first_mask).count();
+				}
+				utf8_first_mask = ~0u;
+			}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+			for (; i + 16 <= size; i += 16) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				const std::uint32_t continuation_mask = _mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8(-64)));
+				const std::uint32_t four_byte_mask = _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(-17))) & _mm_movemask_epi8(v);
+				const std::uint32_t newline_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+				add_block(continuation_mask, four_byte_mask, newline_mask, 0xFFFF, info);
+				const std::uint32_t sign_mask = _mm_movemask_epi8(v);
+				if (sign_mask | utf8_carry) {
+					info.utf8_errors += std::bitset<32>(get_utf8_error_mask(get_utf8_masks(v, continuation_mask, sign_mask), 16, utf8_carry) & utf8_first_mask).count();
+				}
+				utf8_first_mask = ~0u;
+			}
+#endif
+			// the remaining bytes are added one by one, which checks their positions against the last bytes of the blocks
+			for (std::size_t j = 0; j < 3 && j < i; ++j) {
+				info.head |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[j])) << (8 * j);
+				info.tail |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i - 1 - j])) << (8 * j);
+			}
+			for (; i < size; ++i) {
+				info = info + Info(data[i]);
+			}
+			return info;
+		}
+	};
+	// the opening and closing bracket of each kind
+	static constexpr char BRACKETS[] = "()[]{}";
+	static constexpr std::size_t BRACKET_KINDS = 3;
+	struct Brackets {
+		// the net depth and the lowest depth reached by any prefix, which is enough to find the matching bracket by descending through the summaries
+		// 32 bits keep the summaries small, so brackets are only matched correctly while they don't nest more than 2^31 deep
+		std::int32_t depth;
+		std::int32_t min_depth;
+		constexpr Brackets(std::int32_t depth, std::int32_t min_depth): depth(depth), min_depth(min_depth) {}
+		constexpr Brackets(): depth(0), min_depth(0) {}
+		constexpr Brackets(char c, std::size_t kind): depth((c == BRACKETS[2 * kind]) - (c == BRACKETS[2 * kind + 1])), min_depth(-(c == BRACKETS[2 * kind + 1])) {}
+		constexpr Brackets operator +(const Brackets& brackets) const {
+			return Brackets(depth + brackets.depth, std::min(min_depth, depth + brackets.min_depth));
+		}
+		constexpr bool operator ==(const Brackets& brackets) const {
+			return depth == brackets.depth && min_depth == brackets.min_depth;
+		}
+	};
+	struct BracketInfo {
+		// brackets are only matched on request, so they are summarized in a second tree that is built by the first query and then kept up to date by the edits
+		// its elements are runs of text that end with at most one bracket, so that it only grows with the number of brackets
+		struct Run {
+			// the number of bytes before the bracket, the bracket is 0 if the run has none
+			std::uint32_t gap;
+			char bracket;
+		};
+		using T = Run;
+		// leaves are tuned for a node size of 384 bytes like the ones of the text
+		static constexpr std::size_t LEAF_SIZE = 42;
+		static constexpr std::size_t INODE_SIZE = 12;
+		std::size_t bytes;
+		Brackets brackets[BRACKET_KINDS];
+		constexpr BracketInfo(): bytes(0) {}
+		constexpr BracketInfo(const Run& run): bytes(run.gap + (run.bracket != '\0')), brackets{Brackets(run.bracket, std::size_t(0)), Brackets(run.bracket, std::size_t(1)), Brackets(run.bracket, std::size_t(2))} {}
+		constexpr BracketInfo operator +(const BracketInfo& info) const {
+			BracketInfo result;
+			result.bytes = bytes + info.bytes;
+			for (std::size_t kind = 0; kind < BRACKET_KINDS; ++kind) {
+				result.brackets[kind] = brackets[kind] + info.brackets[kind];
+			}
+			return result;
+		}
+		constexpr bool operator ==(const BracketInfo& info) const {
+			for (std::size_t kind = 0; kind < BRACKET_KINDS; ++kind) {
+				if (!(brackets[kind] == info.brackets[kind])) {
+					return false;
+				}
+			}
+			return bytes == info.bytes;
+		}
+		static constexpr bool is_bracket(char c) {
+			for (std::size_t i = 0; i < 2 * BRACKET_KINDS; ++i) {
+				if (c == BRACKETS[i]) {
+					return true;
+				}
+			}
+			return false;
+		}
+		static void add_run(std::size_t& gap, char bracket, std::vector<Run>& runs) {
+			// gaps that don't fit into 32 bits are split into runs without a bracket
+			for (; gap > UINT32_MAX; gap -= UINT32_MAX) {
+				runs.push_back({UINT32_MAX, '\0'});
+			}
+			runs.push_back({static_cast<std::uint32_t>(gap), bracket});
+			gap = 0;
+		}
+		static void add_runs(const char* data, std::size_t size, std::size_t& gap, std::vector<Run>& runs) {
+			// add a run for every bracket in data, gap counts the bytes since the last bracket and carries over to the next call
+			std::size_t start = 0;
+			const auto add = [&](std::size_t j) {
+				gap += j - start;
+				add_run(gap, data[j], runs);
+				start = j + 1;
+			};
+			std::size_t i = 0;
+#if defined(__AVX2__)
+			for (; i + 32 <= size; i += 32) {
+				const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				std::uint32_t mask = 0;
+				for (std::size_t j = 0; j < 2 * BRACKET_KINDS; ++j) {
+					mask |= _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(BRACKETS[j])));
+				}
+				for (; mask; mask &= mask - 1) {
+					add(i + std::bitset<32>(~mask & (mask - 1)).count());
+				}
+			}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+			for (; i + 16 <= size; i += 16) {
+				const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				std::uint32_t mask = 0;
+				for (std::size_t j = 0; j < 2 * BRACKET_KINDS; ++j) {
+					mask |= _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(BRACKETS[j])));
+				}
+				for (; mask; mask &= mask - 1) {
+					add(i + std::bitset<32>(~mask & (mask - 1)).count());
+				}
+			}
+#endif
+			for (; i < size; ++i) {
+				if (is_bracket(data[i])) {
+					add(i);
+				}
+			}
+			gap += size - start;
 		}
 	};
 	class ByteComp {
 		std::size_t bytes;
 	public:
 		constexpr ByteComp(std::size_t bytes): bytes(bytes) {}
-		constexpr bool operator <(const Info& info) const {
+		// works for the text and the brackets
+		template <class I> constexpr bool operator <(const I& info) const {
 			return bytes < info.bytes;
 		}
+		constexpr std::size_t get_index(const Info& sum, const char* data, std::size_t size) const {
+			return bytes < sum.bytes ? 0 : std::min(bytes - sum.bytes, size);
+		}
 	};
 	class CodepointComp {
 		std::size_t codepoints;
@@ -38,6 +364,26 @@ class TextBuffer final: public Input {
 			return codepoints < info.codepoints;
 		}
 	};
+	class LineColumnComp {
+		// the position after the given number of codepoints in the given line, or the end of the line if it is shorter
+		std::size_t newlines;
+		std::size_t column;
+	public:
+		constexpr LineColumnComp(std::size_t newlines, std::size_t column): newlines(newlines), column(column) {}
+		constexpr bool operator <(const Info& info) const {
+			return newlines < info.newlines || (newlines == info.newlines && column < info.column);
+		}
+	};
+	class LineUtf16Comp {
+		// the position after the given number of utf-16 code units in the given line, or the end of the line if it is shorter
+		std::size_t newlines;
+		std::size_t utf16_column;
+	public:
+		constexpr LineUtf16Comp(std::size_t newlines, std::size_t utf16_column): newlines(newlines), utf16_column(utf16_column) {}
+		constexpr bool operator <(const Info& info) const {
+			return newlines < info.newlines || (newlines == info.newlines && utf16_column < info.utf16_column);
+		}
+	};
 	class LineComp {
 		std::size_t newlines;
 	public:
@@ -46,32 +392,594 @@ class TextBuffer final: public Input {
 			return newlines < info.newlines;
 		}
 	};
+	class Utf8ErrorComp {
+		// the position of the first utf-8 error after the given number of errors
+		std::size_t utf8_errors;
+	public:
+		constexpr Utf8ErrorComp(std::size_t utf8_errors): utf8_errors(utf8_errors) {}
+		constexpr bool operator <(const Info& info) const {
+			return utf8_errors < info.utf8_errors;
+		}
+	};
+	class ClosingBracketComp {
+		// searching forward, the first bracket of the given kind that closes a bracket opened before the start
+		std::size_t kind;
+	public:
+		constexpr ClosingBracketComp(std::size_t kind): kind(kind) {}
+		constexpr bool operator <(const BracketInfo& info) const {
+			return info.brackets[kind].min_depth < 0;
+		}
+	};
+	class OpeningBracketComp {
+		// searching backward, the first bracket of the given kind that is still open at the start
+		std::size_t kind;
+	public:
+		constexpr OpeningBracketComp(std::size_t kind): kind(kind) {}
+		constexpr bool operator <(const BracketInfo& info) const {
+			// some suffix has a positive depth
+			return info.brackets[kind].depth > info.brackets[kind].min_depth;
+		}
+	};
+private:
 	Tree<Info> tree;
+	// the bracket summaries and the version of the tree they are up to date with, see BracketInfo
+	mutable Tree<BracketInfo> bracket_tree;
+	mutable std::size_t bracket_version = 0;
+	// the leaves don't know their neighbors, so remember where the last chunk was found
+	mutable Tree<Info>::Iterator chunk_iterator;
+	// consecutive lookups are usually close to each other, for example when typing, moving the cursor or rendering lines
+	mutable Tree<Info>::Cursor cursor;
+	// the chunk that was returned last, where it starts and the version of the tree it was found in
+	mutable Input::Chunk last_chunk = {nullptr, "", 0};
+	mutable std::size_t last_chunk_index = 0;
+	mutable std::size_t last_chunk_version = 0;
+	// the decompressed blocks of the chunks returned since the last call to get_chunk, so that a reader can hold on to every chunk it got until it starts over
+	mutable std::vector<std::shared_ptr<const char>> chunk_blocks;
+	static const void* get_chunk_handle(std::size_t index) {
+		// a chunk is identified by where it starts, so that it can be found again in O(log n) whichever chunk was returned last
+		return reinterpret_cast<const void*>(static_cast<std::uintptr_t>(index) + 1);
+	}
+	static std::size_t get_chunk_start(const void* chunk) {
+		return static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(chunk) - 1);
+	}
+	Input::Chunk set_last_chunk(std::size_t index) const {
+		const auto chunk = chunk_iterator.get_chunk();
+		last_chunk = {get_chunk_handle(index), chunk.first, chunk.second};
+		last_chunk_index = index;
+		last_chunk_version = tree.get_version();
+		const std::shared_ptr<const char>& block = chunk_iterator.get_block();
+		if (block && (chunk_blocks.empty() || chunk_blocks.back() != block)) {
+			chunk_blocks.push_back(block);
+		}
+		return last_chunk;
+	}
+	void find_chunk(std::size_t index) const {
+		chunk_iterator = get_iterator(index);
+		set_last_chunk(index - chunk_iterator.get_index());
+	}
+	void update_bracket_tree() const {
+		// build the bracket summaries from the whole text if they are not up to date
+		if (bracket_version == tree.get_version()) {
+			return;
+		}
+		std::vector<BracketInfo::Run> runs;
+		std::size_t gap = 0;
+		Tree<Info>::Iterator iterator = tree.begin();
+		do {
+			const auto chunk = iterator.get_chunk();
+			BracketInfo::add_runs(chunk.first, chunk.second, gap, runs);
+		} while (iterator.next_leaf());
+		if (gap > 0) {
+			BracketInfo::add_run(gap, '\0', runs);
+		}
+		bracket_tree = Tree<BracketInfo>(runs.data(), runs.data() + runs.size(), std::thread::hardware_concurrency());
+		bracket_version = tree.get_version();
+	}
+	void replace_brackets(std::size_t version, std::size_t index0, std::size_t index1, const char* text, std::size_t size) {
+		// mirror an edit that replaced the text between index0 and index1 if the bracket summaries were up to date with the version before it, otherwise they are rebuilt by the next query
+		if (bracket_version != version) {
+			return;
+		}
+		// the runs from the one that contains index0 to the one that contains index1 are replaced, so that the text around the edit is merged into the new runs
+		const std::size_t start = bracket_tree.get_sum(ByteComp(index0)).bytes;
+		const std::size_t last = bracket_tree.get_sum(ByteComp(index1)).bytes;
+		std::vector<BracketInfo::Run> runs;
+		std::size_t gap = index0 - start;
+		BracketInfo::add_runs(text, size, gap, runs);
+		if (index1 < bracket_tree.get_info().bytes) {
+			const BracketInfo::Run run = *bracket_tree.get(ByteComp(index1));
+			gap += last + run.gap - index1;
+			BracketInfo::add_run(gap, run.bracket, runs);
+			// most edits stay inside of one run, which is cheaper to remove on its own
+			if (last == start) {
+				bracket_tree.remove(ByteComp(start));
+			}
+			else {
+				bracket_tree.remove(ByteComp(start), ByteComp(last + BracketInfo(run).bytes));
+			}
+		}
+		else {
+			if (gap > 0) {
+				BracketInfo::add_run(gap, '\0', runs);
+			}
+			bracket_tree.remove(ByteComp(start), ByteComp(last));
+		}
+		bracket_tree.insert(ByteComp(start), runs.begin(), runs.end());
+		bracket_version = tree.get_version();
+	}
+	void split_bracket_run(std::size_t index) {
+		// let a run start at index, which only has to split a gap because the bracket is always at the end of a run
+		const std::size_t start = bracket_tree.get_sum(ByteComp(index)).bytes;
+		if (start == index) {
+			return;
+		}
+		const BracketInfo::Run run = *bracket_tree.get(ByteComp(index));
+		const BracketInfo::Run runs[] = {{static_cast<std::uint32_t>(index - start), '\0'}, {static_cast<std::uint32_t>(run.gap - (index - start)), run.bracket}};
+		bracket_tree.remove(ByteComp(start));
+		bracket_tree.insert(ByteComp(start), runs, runs + 2);
+	}
+	template <class I> static void move_block(Tree<I>& tree, std::size_t index0, std::size_t index1, std::size_t index) {
+		Tree<I> block = tree.split(ByteComp(index0));
+		tree.concat(block.split(ByteComp(index1 - index0)));
+		if (index > index0) {
+			index -= index1 - index0;
+		}
+		Tree<I> tail = tree.split(ByteComp(index));
+		tree.concat(std::move(block));
+		tree.concat(std::move(tail));
+	}
+	void keep_brackets(std::size_t version) {
+		// the text was only stored differently, so the bracket summaries are still up to date if they were before
+		if (bracket_version == version) {
+			bracket_version = tree.get_version();
+		}
+	}
+	// files of at least this size are not copied but mapped, only the parts that are modified are copied into leaves
+	static constexpr std::size_t MIN_MAPPED_SIZE = 64 * 1024 * 1024;
+	// files are loaded asynchronously in slices of about this size
+	static constexpr std::size_t SLICE_SIZE = 16 * 1024 * 1024;
+	static Tree<Info> create_tree(const std::shared_ptr<const Mmap>& mapping, const char* first, const char* last, std::size_t threads) {
+		if (mapping->get_size() >= MIN_MAPPED_SIZE) {
+			// the mapping stays alive as long as any node refers to it, the file must not be modified in place while it is open
+			return Tree<Info>(first, last, mapping, threads);
+		}
+		return Tree<Info>(first, last, threads);
+	}
+	void append_final_newline() {
+		if (get_size() == 0 || *get_iterator(get_size() - 1) != '\n') {
+			tree.insert(tree_end(), '\n');
+		}
+	}
+	TextBuffer(Tree<Info>&& tree): tree(std::move(tree)) {}
+	// files with a zero byte this close to the start are treated as binary
+	static constexpr std::size_t BINARY_CHECK_SIZE = 8000;
+	// invalid utf-8 is repaired in parts of about this size, each replaced with one removal and one insertion
+	static constexpr std::size_t REPAIR_SIZE = 4096;
+	std::size_t get_sequence_start(std::size_t min, std::size_t index) const {
+		// the start of the sequence the byte before index belongs to, only continuation bytes are skipped so this is where decoding the whole text would start it too
+		std::size_t start = index - 1;
+		while (start > min && (*get_iterator(start) & 0xC0) == 0x80) {
+			--start;
+		}
+		return start;
+	}
+	std::size_t repair_utf8(std::size_t index0, std::size_t index1) {
+		// repair the text from the start of a sequence at index0 to index1, which is moved to the start of the next sequence, returns where the repaired text ends
+		while (index1 < get_size() && (*get_iterator(index1) & 0xC0) == 0x80) {
+			++index1;
+		}
+		std::string text;
+		append_range(text, index0, index1);
+		std::string string;
+		string.reserve(text.size());
+		append_repaired_utf8(string, text.data(), text.size());
+		if (string != text) {
+			remove(index0, index1);
+			insert(index0, string.data(), string.size());
+		}
+		return index0 + string.size();
+	}
+	static void append_repaired_utf8(std::string& string, const char* data, std::size_t size) {
+		// replace every maximal part of an invalid sequence with U+FFFD as recommended by the unicode standard
+		for (std::size_t i = 0; i < size;) {
+			const unsigned char c = data[i];
+			const std::size_t length = c < 0x80 ? 1 : c >= 0xC2 && c <= 0xDF ? 2 : c >= 0xE0 && c <= 0xEF ? 3 : c >= 0xF0 && c <= 0xF4 ? 4 : 0;
+			// the range of the second byte excludes overlong sequences, surrogates and codepoints above U+10FFFF
+			const unsigned char low = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+			const unsigned char high = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+			std::size_t j = 1;
+			for (; j < length && i + j < size; ++j) {
+				const unsigned char next = data[i + j];
+				if (j == 1 ? next < low || next > high : (next & 0xC0) != 0x80) {
+					break;
+				}
+			}
+			if (j == length) {
+				string.append(data + i, length);
+			}
+			else {
+				string.append("\xEF\xBF\xBD");
+			}
+			i += j;
+		}
+	}
+	class Needle {
+		// a literal pattern, if case is ignored it is kept in lowercase and ascii letters match in either case
+		std::string pattern;
+		bool ignore_case;
+		// or-ing a byte with 0x20 folds ascii letters to lowercase, which is only done for the first and the last byte if they are letters
+		char first_fold;
+		char last_fold;
+		static constexpr char to_lower(char c) {
+			return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+		}
+		constexpr char get_fold(char c) const {
+			return ignore_case && c >= 'a' && c <= 'z' ? 0x20 : 0;
+		}
+	public:
+		Needle(const char* data, std::size_t size, bool ignore_case): pattern(data, size), ignore_case(ignore_case), first_fold(0), last_fold(0) {
+			if (ignore_case) {
+				for (char& c: pattern) {
+					c = to_lower(c);
+				}
+			}
+			if (size > 0) {
+				first_fold = get_fold(pattern.front());
+				last_fold = get_fold(pattern.back());
+			}
+		}
+		std::size_t size() const {
+			return pattern.size();
+		}
+		bool matches(const char* data) const {
+			if (!ignore_case) {
+				return std::memcmp(data, pattern.data(), pattern.size()) == 0;
+			}
+			for (std::size_t j = 0; j < pattern.size(); ++j) {
+				if (to_lower(data[j]) != pattern[j]) {
+					return false;
+				}
+			}
+			return true;
+		}
+#if defined(__AVX2__)
+		std::uint32_t get_candidates_32(const char* data) const {
+			// the positions of a block of 32 bytes at which the first and the last byte match, data must extend to the last byte of the last position
+			const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+			const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pattern.size() - 1));
+			const std::uint32_t first_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(v0, _mm256_set1_epi8(first_fold)), _mm256_set1_epi8(pattern.front())));
+			const std::uint32_t last_mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(v1, _mm256_set1_epi8(last_fold)), _mm256_set1_epi8(pattern.back())));
+			return first_mask & last_mask;
+		}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+		std::uint32_t get_candidates_16(const char* data) const {
+			const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+			const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pattern.size() - 1));
+			const std::uint32_t first_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v0, _mm_set1_epi8(first_fold)), _mm_set1_epi8(pattern.front())));
+			const std::uint32_t last_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v1, _mm_set1_epi8(last_fold)), _mm_set1_epi8(pattern.back())));
+			return first_mask & last_mask;
+		}
+#endif
+	};
+	template <class F> static bool scan_forward(const char* data, std::size_t first, std::size_t last, const Needle& needle, F&& f) {
+		// call f with every match that starts in [first, last) in order until it returns true, data must extend to the end of a match at last - 1
+		// like memchr for the first and the last byte at once, only the positions where both match are compared
+		std::size_t i = first;
+#if defined(__AVX2__)
+		for (; i + 32 <= last; i += 32) {
+			for (std::uint32_t mask = needle.get_candidates_32(data + i); mask; mask &= mask - 1) {
+				const std::size_t j = i + std::bitset<32>(~mask & (mask - 1)).count();
+				if (needle.matches(data + j) && f(j)) {
+					return true;
+				}
+			}
+		}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+		for (; i + 16 <= last; i += 16) {
+			for (std::uint32_t mask = needle.get_candidates_16(data + i); mask; mask &= mask - 1) {
+				const std::size_t j = i + std::bitset<32>(~mask & (mask - 1)).count();
+				if (needle.matches(data + j) && f(j)) {
+					return true;
+				}
+			}
+		}
+#endif
+		for (; i < last; ++i) {
+			if (needle.matches(data + i) && f(i)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	template <class F> static bool scan_backward(const char* data, std::size_t first, std::size_t last, const Needle& needle, F&& f) {
+		// call f with every match that starts in [first, last) in reverse order until it returns true
+		std::size_t i = last;
+#if defined(__AVX2__)
+		for (; i >= first + 32; i -= 32) {
+			if (const std::uint32_t mask = needle.get_candidates_32(data + i - 32)) {
+				for (std::size_t j = 32; j-- > 0;) {
+					if ((mask >> j & 1) && needle.matches(data + i - 32 + j) && f(i - 32 + j)) {
+						return true;
+					}
+				}
+			}
+		}
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+		for (; i >= first + 16; i -= 16) {
+			if (const std::uint32_t mask = needle.get_candidates_16(data + i - 16)) {
+				for (std::size_t j = 16; j-- > 0;) {
+					if ((mask >> j & 1) && needle.matches(data + i - 16 + j) && f(i - 16 + j)) {
+						return true;
+					}
+				}
+			}
+		}
+#endif
+		while (i > first) {
+			--i;
+			if (needle.matches(data + i) && f(i)) {
+				return true;
+			}
+		}
+		return false;
+	}
+	template <class F> bool search_forward(std::size_t index, const Needle& needle, F&& f) const {
+		// call f with every match that starts at or after index in order until it returns true, f must not access the buffer
+		// matches that span chunks are found in a copy of the last n - 1 bytes before a chunk and the first n - 1 bytes of it
+		const std::size_t n = needle.size();
+		if (n == 0 || index + n > get_size()) {
+			return false;
+		}
+		// the search has its own iterator, which keeps a decompressed chunk alive while it is searched
+		Tree<Info>::Iterator iterator = get_iterator(index);
+		std::size_t offset = iterator.get_index();
+		std::size_t chunk_index = index - offset;
+		std::string carry;
+		std::string seam;
+		do {
+			const std::pair<const char*, std::size_t> chunk = iterator.get_chunk();
+			if (!carry.empty()) {
+				seam.assign(carry);
+				seam.append(chunk.first, std::min(n - 1, chunk.second));
+				const std::size_t seam_index = chunk_index - carry.size();
+				if (seam.size() >= n && scan_forward(seam.data(), 0, std::min(carry.size(), seam.size() - n + 1), needle, [&](std::size_t i) {
+					return f(seam_index + i);
+				})) {
+					return true;
+				}
+			}
+			if (chunk.second - offset >= n && scan_forward(chunk.first, offset, chunk.second - n + 1, needle, [&](std::size_t i) {
+				return f(chunk_index + i);
+			})) {
+				return true;
+			}
+			if (chunk.second - offset >= n - 1) {
+				carry.assign(chunk.first + chunk.second - (n - 1), n - 1);
+			}
+			else {
+				carry.append(chunk.first + offset, chunk.second - offset);
+				if (carry.size() > n - 1) {
+					carry.erase(0, carry.size() - (n - 1));
+				}
+			}
+			chunk_index += chunk.second;
+			offset = 0;
+		} while (iterator.next_leaf());
+		return false;
+	}
+	template <class F> bool search_backward(std::size_t index, const Needle& needle, F&& f) const {
+		// call f with every match that starts before index in reverse order until it returns true, f must not access the buffer
+		// the chunks are visited from the end, with a copy of the first n - 1 bytes after each of them
+		const std::size_t n = needle.size();
+		if (n == 0 || n > get_size()) {
+			return false;
+		}
+		index = std::min(index, get_size() - n + 1);
+		if (index == 0) {
+			return false;
+		}
+		Tree<Info>::Iterator iterator = get_iterator(index - 1);
+		std::pair<const char*, std::size_t> chunk = iterator.get_chunk();
+		std::size_t chunk_index = index - 1 - iterator.get_index();
+		std::string carry;
+		const std::size_t chunk_end = chunk_index + chunk.second;
+		if (chunk_end < get_size()) {
+			append_range(carry, chunk_end, std::min(chunk_end + n - 1, get_size()));
+		}
+		std::size_t limit = index - chunk_index;
+		std::string seam;
+		while (true) {
+			const std::size_t tail = std::min(n - 1, chunk.second);
+			const std::size_t seam_index = chunk_index + chunk.second - tail;
+			if (!carry.empty() && seam_index < chunk_index + limit) {
+				seam.assign(chunk.first + chunk.second - tail, tail);
+				seam.append(carry);
+				if (seam.size() >= n && scan_backward(seam.data(), 0, std::min({tail, seam.size() - n + 1, chunk_index + limit - seam_index}), needle, [&](std::size_t i) {
+					return f(seam_index + i);
+				})) {
+					return true;
+				}
+			}
+			if (chunk.second >= n && scan_backward(chunk.first, 0, std::min(limit, chunk.second - n + 1), needle, [&](std::size_t i) {
+				return f(chunk_index + i);
+			})) {
+				return true;
+			}
+			if (chunk_index == 0) {
+				return false;
+			}
+			if (chunk.second >= n - 1) {
+				carry.assign(chunk.first, n - 1);
+			}
+			else {
+				carry.insert(0, chunk.first, chunk.second);
+				carry.resize(std::min(carry.size(), n - 1));
+			}
+			iterator.previous_leaf();
+			chunk = iterator.get_chunk();
+			chunk_index -= chunk.second;
+			limit = chunk.second;
+		}
+	}
 public:
 	TextBuffer() {
 		tree.insert(tree_end(), '\n');
 	}
-	TextBuffer(const char* path) {
-		std::ifstream file(path);
-		tree.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
-		if (get_size() == 0 || *get_iterator(get_size() - 1) != '\n') {
-			tree.insert(tree_end(), '\n');
+	TextBuffer(const char* path, std::size_t threads = std::thread::hardware_concurrency()) {
+		if (Mmap mmap = Mmap(path)) {
+			auto mapping = std::make_shared<const Mmap>(std::move(mmap));
+			tree = create_tree(mapping, mapping->begin(), mapping->end(), threads);
+		}
+		else {
+			// empty files and files that can't be mapped are read as a stream
+			std::ifstream file(path);
+			tree.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		}
+		append_final_newline();
+	}
+	template <class F> static void load(const char* path, std::size_t threads, F&& f) {
+		// load a file one slice at a time, f(buffer, loaded, total) is called with the part that has been loaded so far and returns false to stop
+		// the parts end at a newline so that no line is seen partially, the last call gets the whole file
+		Mmap mmap(path);
+		if (!mmap) {
+			// empty files and files that can't be mapped are read as a stream, the total is the size of the file without the final newline that is added
+			TextBuffer buffer{Tree<Info>()};
+			std::ifstream file(path);
+			buffer.tree.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			const std::size_t size = buffer.get_size();
+			buffer.append_final_newline();
+			f(std::as_const(buffer), size, size);
+			return;
+		}
+		auto mapping = std::make_shared<const Mmap>(std::move(mmap));
+		TextBuffer buffer{Tree<Info>()};
+		const char* first = mapping->begin();
+		while (first != mapping->end()) {
+			const char* last = first + std::min<std::size_t>(SLICE_SIZE, mapping->end() - first);
+			if (const void* newline = std::memchr(last - 1, '\n', mapping->end() - (last - 1))) {
+				last = static_cast<const char*>(newline) + 1;
+			}
+			else {
+				last = mapping->end();
+			}
+			buffer.tree.concat(create_tree(mapping, first, last, threads));
+			first = last;
+			if (first != mapping->end() && !f(std::as_const(buffer), first - mapping->begin(), mapping->get_size())) {
+				return;
+			}
 		}
+		buffer.append_final_newline();
+		f(std::as_const(buffer), mapping->get_size(), mapping->get_size());
+	}
+	TextBuffer snapshot() const {
+		// an O(1) copy that shares its nodes with this buffer and can be read from another thread
+		return *this;
 	}
 	Info get_info() const {
 		return tree.get_info();
 	}
 	Info get_info_for_index(std::size_t index) const {
-		return tree.get_sum(ByteComp(index));
+		return cursor.get_sum(tree, ByteComp(index));
 	}
 	Info get_info_for_codepoints(std::size_t codepoints) const {
-		return tree.get_sum(CodepointComp(codepoints));
+		return cursor.get_sum(tree, CodepointComp(codepoints));
 	}
 	Info get_info_for_line_start(std::size_t line) const {
-		return line == 0 ? Info() : tree.get_sum(LineComp(line - 1)) + Info('\n');
+		return line == 0 ? Info() : cursor.get_sum(tree, LineComp(line - 1)) + Info('\n');
 	}
 	Info get_info_for_line_end(std::size_t line) const {
-		return tree.get_sum(LineComp(line));
+		return cursor.get_sum(tree, LineComp(line));
+	}
+	Info get_info_for_line_column(std::size_t line, std::size_t column) const {
+		// resolve a line and a column in codepoints in a single descent, the column is clamped to the end of the line
+		return cursor.get_sum(tree, LineColumnComp(line, column));
+	}
+	Info get_info_for_line_utf16(std::size_t line, std::size_t utf16_column) const {
+		// resolve a line and a column in utf-16 code units as used by the language server protocol, a column inside a surrogate pair resolves to the start of its codepoint
+		return cursor.get_sum(tree, LineUtf16Comp(line, utf16_column));
+	}
+	bool find_closing_bracket(std::size_t index, std::size_t kind, std::size_t& result) const {
+		// the first bracket of the given kind at or after index that closes a bracket opened before index
+		update_bracket_tree();
+		// the run that contains index has its bracket at or after index
+		Tree<BracketInfo>::Iterator iterator = bracket_tree.get(ByteComp(index));
+		BracketInfo sum;
+		if (!Tree<BracketInfo>::find_next(iterator, sum, ClosingBracketComp(kind))) {
+			return false;
+		}
+		result = bracket_tree.get_sum(ByteComp(index)).bytes + sum.bytes + (*iterator).gap;
+		return true;
+	}
+	bool find_opening_bracket(std::size_t index, std::size_t kind, std::size_t& result) const {
+		// the last bracket of the given kind before index that is still open at index
+		update_bracket_tree();
+		Tree<BracketInfo>::Iterator iterator = bracket_tree.get(ByteComp(index));
+		BracketInfo sum;
+		if (!Tree<BracketInfo>::find_previous(iterator, sum, OpeningBracketComp(kind))) {
+			return false;
+		}
+		// the bracket ends the run that was found
+		result = bracket_tree.get_sum(ByteComp(index)).bytes - sum.bytes - 1;
+		return true;
+	}
+	bool find_matching_bracket(std::size_t index, std::size_t& result) const {
+		// brackets in strings and comments count as well, the summaries don't know the syntax
+		if (index >= get_size()) {
+			return false;
+		}
+		const char c = *get_iterator(index);
+		for (std::size_t kind = 0; kind < BRACKET_KINDS; ++kind) {
+			if (c == BRACKETS[2 * kind]) {
+				return find_closing_bracket(index + 1, kind, result);
+			}
+			if (c == BRACKETS[2 * kind + 1]) {
+				return find_opening_bracket(index, kind, result);
+			}
+		}
+		return false;
+	}
+	bool find_enclosing_brackets(std::size_t index, std::size_t& open, std::size_t& close) const {
+		// the innermost pair of brackets of any kind with open < index <= close
+		bool found = false;
+		for (std::size_t kind = 0; kind < BRACKET_KINDS; ++kind) {
+			std::size_t kind_open, kind_close;
+			if (find_opening_bracket(index, kind, kind_open) && (!found || kind_open > open) && find_closing_bracket(index, kind, kind_close)) {
+				open = kind_open;
+				close = kind_close;
+				found = true;
+			}
+		}
+		return found;
+	}
+	bool find_next(std::size_t index, const char* needle, std::size_t size, bool ignore_case, std::size_t& result) const {
+		// the first match of needle that starts at or after index, ignore_case only applies to ascii letters
+		return search_forward(index, Needle(needle, size, ignore_case), [&](std::size_t match) {
+			result = match;
+			return true;
+		});
+	}
+	bool find_previous(std::size_t index, const char* needle, std::size_t size, bool ignore_case, std::size_t& result) const {
+		// the last match of needle that starts before index
+		return search_backward(index, Needle(needle, size, ignore_case), [&](std::size_t match) {
+			result = match;
+			return true;
+		});
+	}
+	std::vector<std::size_t> find_all(const char* needle, std::size_t size, bool ignore_case) const {
+		// the starts of all matches in order, a match that overlaps the previous one is skipped
+		std::vector<std::size_t> matches;
+		std::size_t next = 0;
+		search_forward(0, Needle(needle, size, ignore_case), [&](std::size_t match) {
+			if (match >= next) {
+				matches.push_back(match);
+				next = match + size;
+			}
+			return false;
+		});
+		return matches;
 	}
 	std::size_t get_size() const {
 		return get_info().bytes;
@@ -79,14 +987,126 @@ public:
 	std::size_t get_total_lines() const {
 		return get_info().newlines;
 	}
+	std::size_t get_longest_line() const {
+		// the length of the longest line in codepoints, without its newline
+		const Info info = get_info();
+		return std::max(info.longest_line, info.column);
+	}
+	std::size_t get_utf8_errors() const {
+		// the text is checked as if it was surrounded by ascii, so that the first positions count and a sequence that is cut off at the end is an error
+		return (Info('\0') + Info('\0') + Info('\0') + get_info() + Info('\0')).utf8_errors;
+	}
+	enum class Encoding {
+		UTF8,
+		INVALID_UTF8,
+		BINARY
+	};
+	Encoding get_encoding() const {
+		// like git, binary files are recognized by a zero byte near the start, the utf-8 errors are known from the summary
+		std::size_t checked = 0;
+		Tree<Info>::Iterator iterator = tree.begin();
+		do {
+			const auto chunk = iterator.get_chunk();
+			if (std::memchr(chunk.first, '\0', std::min(chunk.second, BINARY_CHECK_SIZE - checked))) {
+				return Encoding::BINARY;
+			}
+			checked += chunk.second;
+		} while (checked < BINARY_CHECK_SIZE && iterator.next_leaf());
+		return get_utf8_errors() == 0 ? Encoding::UTF8 : Encoding::INVALID_UTF8;
+	}
+	void repair_utf8() {
+		// the errors are found by descending through the summaries and only the text around them is replaced, so the rest of a mapped file stays mapped
+		if (get_utf8_errors() == 0) {
+			return;
+		}
+		// the summaries don't count the first 3 positions
+		std::size_t index = repair_utf8(0, std::min(get_size(), REPAIR_SIZE));
+		while (true) {
+			const std::size_t errors = get_info_for_index(index).utf8_errors;
+			if (errors == get_info().utf8_errors) {
+				break;
+			}
+			const std::size_t error = cursor.get_sum(tree, Utf8ErrorComp(errors)).bytes;
+			const std::size_t start = error > index ? get_sequence_start(index, error) : index;
+			index = repair_utf8(start, std::min(get_size(), start + REPAIR_SIZE));
+		}
+		// nor a sequence that is cut off at the end
+		if (get_utf8_errors() > 0) {
+			repair_utf8(get_sequence_start(0, get_size()), get_size());
+		}
+	}
 	void insert(std::size_t index, char c) {
+		const std::size_t version = tree.get_version();
 		tree.insert(ByteComp(index), c);
+		replace_brackets(version, index, index, &c, 1);
+	}
+	void insert(std::size_t index, const char* text, std::size_t size) {
+		const std::size_t version = tree.get_version();
+		tree.insert(ByteComp(index), text, text + size);
+		replace_brackets(version, index, index, text, size);
 	}
 	void remove(std::size_t index) {
+		const std::size_t version = tree.get_version();
 		tree.remove(ByteComp(index));
+		replace_brackets(version, index, index + 1, nullptr, 0);
+	}
+	void remove(std::size_t index0, std::size_t index1) {
+		const std::size_t version = tree.get_version();
+		tree.remove(ByteComp(index0), ByteComp(index1));
+		replace_brackets(version, index0, index1, nullptr, 0);
+	}
+	std::string cut(std::size_t index0, std::size_t index1) {
+		const std::size_t version = tree.get_version();
+		Tree<Info> text = tree.split(ByteComp(index0));
+		tree.concat(text.split(ByteComp(index1 - index0)));
+		replace_brackets(version, index0, index1, nullptr, 0);
+		std::string string;
+		string.reserve(index1 - index0);
+		for (auto i = text.chunks_begin(); i != text.chunks_end(); ++i) {
+			string.append((*i).first, (*i).second);
+		}
+		return string;
+	}
+	void move_block(std::size_t index0, std::size_t index1, std::size_t index) {
+		// move the text between index0 and index1 to index, which must not lie inside of it
+		const std::size_t version = tree.get_version();
+		move_block(tree, index0, index1, index);
+		if (bracket_version == version) {
+			// the runs are split at the ends of the block and at index so that they can be moved the same way
+			split_bracket_run(index0);
+			split_bracket_run(index1);
+			split_bracket_run(index);
+			move_block(bracket_tree, index0, index1, index);
+			bracket_version = tree.get_version();
+		}
+	}
+	void compact() {
+		const std::size_t version = tree.get_version();
+		tree.compact();
+		keep_brackets(version);
+	}
+	std::size_t compact(std::size_t index, std::size_t size) {
+		// compact a slice of the buffer so that compaction can be spread over idle time, returns where to continue
+		const std::size_t version = tree.get_version();
+		Tree<Info> slice = tree.split(ByteComp(index));
+		Tree<Info> tail = slice.split(ByteComp(size));
+		slice.compact();
+		tree.concat(std::move(slice));
+		tree.concat(std::move(tail));
+		keep_brackets(version);
+		return std::min(index + size, get_size());
+	}
+	void compress(std::size_t keep = 16) {
+		// compress the parts of the buffer that were not modified recently, reading them later only decompresses them into a small cache
+		const std::size_t version = tree.get_version();
+		tree.compress(keep);
+		keep_brackets(version);
+	}
+	Tree<Info>::Stats get_stats() const {
+		return tree.get_stats();
 	}
 	Tree<Info>::Iterator get_iterator(std::size_t index) const {
-		return tree.get(ByteComp(index));
+		return cursor.get(tree, ByteComp(index));
 	}
 	Tree<Info>::Iterator begin() const {
 		return tree.begin();
@@ -94,23 +1114,107 @@ public:
 	Tree<Info>::Iterator end() const {
 		return tree.end();
 	}
-	void save(const char* path) {
-		std::ofstream file(path);
-		std::copy(tree.begin(), tree.end(), std::ostreambuf_iterator<char>(file));
+	char* copy_range(std::size_t index0, std::size_t index1, char* out) const {
+		// copy the text between index0 and index1 to out one chunk at a time and return the end of the copied text
+		Tree<Info>::Iterator iterator = get_iterator(index0);
+		std::size_t offset = iterator.get_index();
+		std::size_t size = index1 - index0;
+		while (size > 0) {
+			const auto chunk = iterator.get_chunk();
+			const std::size_t n = std::min(chunk.second - offset, size);
+			std::memcpy(out, chunk.first + offset, n);
+			out += n;
+			size -= n;
+			offset = 0;
+			iterator.next_leaf();
+		}
+		return out;
+	}
+	void append_range(std::string& string, std::size_t index0, std::size_t index1) const {
+		const std::size_t size = string.size();
+		string.resize(size + (index1 - index0));
+		copy_range(index0, index1, &string[size]);
+	}
+	bool save(const char* path) const {
+		// write the chunks straight from the leaves and the mapping, the file is only replaced once everything has been written
+		// the writes are batched, so decompressed chunks are handed to the file together with the block that keeps them alive
+		AtomicFile file(path);
+		Tree<Info>::Iterator iterator = tree.begin();
+		do {
+			const auto chunk = iterator.get_chunk();
+			file.write(chunk.first, chunk.second, iterator.get_block());
+		} while (iterator.next_leaf());
+		return file.commit();
 	}
 	std::pair<Input::Chunk, std::size_t> get_chunk(std::size_t index) const override {
-		const auto iterator = get_iterator(index);
-		auto leaf = iterator.get_leaf();
-		return {{leaf, leaf->children.get_data(), leaf->children.get_size()}, index - iterator.get_index()};
+		// parts of a mapped or compressed file that have no leaves yet are returned as a whole, straight from the mapping or decompressed
+		// the chunks stay valid until the buffer is modified, decompressed ones also only until get_chunk is called again
+		chunk_blocks.clear();
+		find_chunk(index);
+		return {last_chunk, last_chunk_index};
 	}
 	Input::Chunk get_next_chunk(const void* chunk) const override {
-		auto next_leaf = static_cast<const Tree<Info>::Leaf*>(chunk)->next_leaf;
-		if (next_leaf) {
-			return {next_leaf, next_leaf->children.get_data(), next_leaf->children.get_size()};
+		if (chunk != last_chunk.chunk || last_chunk_version != tree.get_version()) {
+			// the chunks are not requested in order or the buffer changed in between, find the chunk again
+			find_chunk(get_chunk_start(chunk));
 		}
-		else {
+		const std::size_t index = last_chunk_index + last_chunk.size;
+		if (index >= get_size()) {
 			return {nullptr, "", 0};
 		}
+		chunk_iterator.next_leaf();
+		return set_last_chunk(index);
+	}
+};
+
+class FileLoader {
+	// loads a file on a background thread and publishes the part that has been loaded so far
+	std::mutex mutex;
+	TextBuffer buffer;
+	std::size_t loaded = 0;
+	std::size_t total = 0;
+	// counts the published parts, so that poll only takes over new ones
+	std::size_t published = 0;
+	bool done = false;
+	std::atomic<bool> cancelled;
+	std::thread thread;
+public:
+	FileLoader(const char* path, std::function<void(std::size_t, std::size_t)> progress, std::size_t threads): cancelled(false) {
+		thread = std::thread([this, path = std::string(path), progress = std::move(progress), threads]() {
+			TextBuffer::load(path.c_str(), threads, [&](const TextBuffer& buffer, std::size_t loaded, std::size_t total) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					this->buffer = buffer.snapshot();
+					this->loaded = loaded;
+					this->total = total;
+					++published;
+				}
+				// progress is called from the loading thread
+				if (progress) {
+					progress(loaded, total);
+				}
+				return !cancelled.load(std::memory_order_relaxed);
+			});
+			std::lock_guard<std::mutex> lock(mutex);
+			done = true;
+		});
+	}
+	FileLoader(const FileLoader&) = delete;
+	~FileLoader() {
+		cancelled.store(true, std::memory_order_relaxed);
+		thread.join();
+	}
+	FileLoader& operator =(const FileLoader&) = delete;
+	bool poll(TextBuffer& buffer, std::size_t& loaded, std::size_t& total, std::size_t& version) {
+		// take over the latest part if it is newer than version, returns false once the whole file has been taken over
+		std::lock_guard<std::mutex> lock(mutex);
+		if (published != version) {
+			buffer = this->buffer.snapshot();
+			version = published;
+		}
+		loaded = this->loaded;
+		total = this->total;
+		return !done;
 	}
 };
 
@@ -212,6 +1316,8 @@ struct RenderedLine {
 	std::vector<Span> spans;
 	std::vector<Range> selections;
 	std::vector<std::size_t> cursors;
+	// the brackets next to a cursor and the brackets they match
+	std::vector<std::size_t> brackets;
 };
 
 constexpr Range operator -(const Range& range, std::size_t pos) {
@@ -223,6 +1329,29 @@ class Editor {
 	const Language* language;
 	mutable Cache cache;
 	Selections selections;
+	// while a file is loaded asynchronously it can be rendered and navigated but not modified
+	std::unique_ptr<FileLoader> loader;
+	std::size_t loader_version = 0;
+	// invalid utf-8 is repaired once the file is loaded, binary files are shown byte by byte and can't be modified
+	TextBuffer::Encoding encoding = TextBuffer::Encoding::UTF8;
+	// large buffers are kept compressed except for the parts that were edited recently, they are compressed again every so many edits
+	static constexpr std::size_t MIN_COMPRESSED_SIZE = 16 * 1024 * 1024;
+	static constexpr std::size_t COMPRESS_INTERVAL = 1024;
+	std::size_t edits = 0;
+	void check_encoding() {
+		encoding = buffer.get_encoding();
+		if (encoding == TextBuffer::Encoding::INVALID_UTF8) {
+			buffer.repair_utf8();
+			cache.invalidate(0);
+			selections.set_selection(0);
+		}
+	}
+	void finish_loading() {
+		check_encoding();
+		if (buffer.get_size() >= MIN_COMPRESSED_SIZE) {
+			buffer.compress();
+		}
+	}
 	void highlight(std::vector<Span>& spans, std::size_t index0, std::size_t index1) const {
 		if (language == nullptr) {
 			return;
@@ -251,6 +1380,56 @@ class Editor {
 			}
 		}
 	}
+	std::vector<std::size_t> get_bracket_matches() const {
+		// the bracket at or else before each cursor and its match, sorted
+		std::vector<std::size_t> brackets;
+		if (loader) {
+			// the first match summarizes the brackets of the whole buffer, which is only worth it once the buffer stops being replaced by larger parts
+			return brackets;
+		}
+		for (const Selection& selection: selections) {
+			std::size_t match;
+			if (buffer.find_matching_bracket(selection.head, match)) {
+				brackets.push_back(selection.head);
+				brackets.push_back(match);
+			}
+			else if (selection.head > 0 && buffer.find_matching_bracket(selection.head - 1, match)) {
+				brackets.push_back(selection.head - 1);
+				brackets.push_back(match);
+			}
+		}
+		std::sort(brackets.begin(), brackets.end());
+		brackets.erase(std::unique(brackets.begin(), brackets.end()), brackets.end());
+		return brackets;
+	}
+	static void render_brackets(RenderedLine& line, const std::vector<std::size_t>& brackets, std::size_t index0, std::size_t index1) {
+		for (auto i = std::lower_bound(brackets.begin(), brackets.end(), index0); i != brackets.end() && *i < index1; ++i) {
+			line.brackets.emplace_back(*i - index0);
+		}
+	}
+	void render(RenderedLine& line, std::size_t i, const std::vector<std::size_t>& brackets) const {
+		std::size_t index0 = 0;
+		std::size_t index1 = 0;
+		if (i < get_total_lines()) {
+			index0 = buffer.get_info_for_line_start(i).bytes;
+			index1 = buffer.get_info_for_line_start(i + 1).bytes;
+		}
+		line.text.clear();
+		buffer.append_range(line.text, index0, index1);
+		if (encoding == TextBuffer::Encoding::BINARY) {
+			// every byte that is not printable ascii is shown as a dot, so that the offsets stay the same
+			for (char& c: line.text) {
+				const unsigned char byte = c;
+				if ((byte < 0x20 && c != '\t' && c != '\n') || byte >= 0x7F) {
+					c = '.';
+				}
+			}
+		}
+		line.number = i + 1;
+		highlight(line.spans, index0, index1);
+		render_selections(line, index0, index1);
+		render_brackets(line, brackets, index0, index1);
+	}
 	static const char* get_file_name(const char* path) {
 		const char* file_name = path;
 		for (const char* i = path; *i != '\0'; ++i) {
@@ -264,6 +1443,9 @@ class Editor {
 		if (index == 0) {
 			return 0;
 		}
+		if (encoding == TextBuffer::Encoding::BINARY) {
+			return index - 1;
+		}
 		const std::size_t codepoints = buffer.get_info_for_index(index).codepoints - 1;
 		return buffer.get_info_for_codepoints(codepoints).bytes;
 	}
@@ -271,28 +1453,25 @@ class Editor {
 		if (index == buffer.get_size() - 1) {
 			return index;
 		}
+		if (encoding == TextBuffer::Encoding::BINARY) {
+			return index + 1;
+		}
 		const std::size_t codepoints = buffer.get_info_for_index(index).codepoints + 1;
 		return buffer.get_info_for_codepoints(codepoints).bytes;
 	}
 	std::size_t get_index_above(std::size_t index) const {
-		const std::size_t line = buffer.get_info_for_index(index).newlines;
-		if (line == 0) {
+		const auto info = buffer.get_info_for_index(index);
+		if (info.newlines == 0) {
 			return 0;
 		}
-		const std::size_t column = buffer.get_info_for_index(index).codepoints - buffer.get_info_for_line_start(line).codepoints;
-		const std::size_t codepoints = buffer.get_info_for_line_start(line - 1).codepoints + column;
-		const std::size_t max_codepoints = buffer.get_info_for_line_end(line - 1).codepoints;
-		return buffer.get_info_for_codepoints(std::min(codepoints, max_codepoints)).bytes;
+		return buffer.get_info_for_line_column(info.newlines - 1, info.column).bytes;
 	}
 	std::size_t get_index_below(std::size_t index) const {
-		const std::size_t line = buffer.get_info_for_index(index).newlines;
-		if (line == buffer.get_total_lines() - 1) {
+		const auto info = buffer.get_info_for_index(index);
+		if (info.newlines == buffer.get_total_lines() - 1) {
 			return buffer.get_size() - 1;
 		}
-		const std::size_t column = buffer.get_info_for_index(index).codepoints - buffer.get_info_for_line_start(line).codepoints;
-		const std::size_t codepoints = buffer.get_info_for_line_start(line + 1).codepoints + column;
-		const std::size_t max_codepoints = buffer.get_info_for_line_end(line + 1).codepoints;
-		return buffer.get_info_for_codepoints(std::min(codepoints, max_codepoints)).bytes;
+		return buffer.get_info_for_line_column(info.newlines + 1, info.column).bytes;
 	}
 	class SelectionIterator {
 	public:
@@ -318,12 +1497,21 @@ class Editor {
 			Selection& selection = editor->selections[i];
 			if (!selection.is_empty()) {
 				editor->cache.invalidate(selection.min());
-				for (std::size_t i = selection.min(); i < selection.max(); ++i) {
-					editor->buffer.remove(selection.min());
-					++deletion_offset;
-				}
+				editor->buffer.remove(selection.min(), selection.max());
+				deletion_offset += selection.max() - selection.min();
+				selection = selection.min();
+			}
+		}
+		std::string cut_text() {
+			Selection& selection = editor->selections[i];
+			std::string text;
+			if (!selection.is_empty()) {
+				editor->cache.invalidate(selection.min());
+				text = editor->buffer.cut(selection.min(), selection.max());
+				deletion_offset += selection.max() - selection.min();
 				selection = selection.min();
 			}
+			return text;
 		}
 		void insert(char c) {
 			Selection& selection = editor->selections[i];
@@ -332,33 +1520,57 @@ class Editor {
 			selection += 1;
 			++insertion_offset;
 		}
-		void insert(const char* text) {
+		void insert(const char* text, std::size_t size) {
 			Selection& selection = editor->selections[i];
 			editor->cache.invalidate(selection.head);
-			for (const char* c = text; *c; ++c) {
-				editor->buffer.insert(selection.head, *c);
-				selection += 1;
-				++insertion_offset;
-			}
+			editor->buffer.insert(selection.head, text, size);
+			selection += size;
+			insertion_offset += size;
+		}
+		void insert(const char* text) {
+			insert(text, std::strlen(text));
 		}
 	};
 public:
 	Editor(): language(nullptr) {}
-	Editor(const char* path): buffer(path), language(prism::get_language(get_file_name(path))) {}
+	Editor(const char* path, std::size_t threads = std::thread::hardware_concurrency()): buffer(path, threads), language(prism::get_language(get_file_name(path))) {
+		finish_loading();
+	}
+	Editor(const char* path, std::function<void(std::size_t, std::size_t)> progress, std::size_t threads = std::thread::hardware_concurrency()): language(prism::get_language(get_file_name(path))), loader(std::make_unique<FileLoader>(path, std::move(progress), threads)) {}
+	bool poll_loading(std::size_t& loaded, std::size_t& total) {
+		// take over the part of the file that has been loaded so far, returns true while the file is still loading
+		if (!loader) {
+			loaded = total = buffer.get_size();
+			return false;
+		}
+		const std::size_t size = buffer.get_size();
+		const std::size_t version = loader_version;
+		const bool loading = loader->poll(buffer, loaded, total, loader_version);
+		if (loader_version != version) {
+			// the new part only extends the old one, which ends with a newline
+			cache.invalidate(size - 1);
+		}
+		if (!loading) {
+			loader.reset();
+			finish_loading();
+		}
+		return loading;
+	}
+	bool is_loading() const {
+		return loader != nullptr;
+	}
+	TextBuffer::Encoding get_encoding() const {
+		// the encoding the file was found in, INVALID_UTF8 means that it has been repaired
+		return encoding;
+	}
 	std::size_t get_total_lines() const {
 		return buffer.get_total_lines();
 	}
+	std::size_t get_longest_line() const {
+		return buffer.get_longest_line();
+	}
 	void render(RenderedLine& line, std::size_t i) const {
-		std::size_t index0 = 0;
-		std::size_t index1 = 0;
-		if (i < get_total_lines()) {
-			index0 = buffer.get_info_for_line_start(i).bytes;
-			index1 = buffer.get_info_for_line_start(i + 1).bytes;
-		}
-		line.text = std::string(buffer.get_iterator(index0), buffer.get_iterator(index1));
-		line.number = i + 1;
-		highlight(line.spans, index0, index1);
-		render_selections(line, index0, index1);
+		render(line, i, get_bracket_matches());
 	}
 	RenderedLine render(std::size_t i) const {
 		RenderedLine line;
@@ -366,19 +1578,39 @@ public:
 		return line;
 	}
 	std::vector<RenderedLine> render(std::size_t first_line, std::size_t last_line) const {
+		// the brackets are matched once for all lines
+		const std::vector<std::size_t> brackets = get_bracket_matches();
 		std::vector<RenderedLine> lines;
 		for (std::size_t i = first_line; i < last_line; ++i) {
 			RenderedLine& line = lines.emplace_back();
-			render(line, i);
+			render(line, i, brackets);
 		}
 		return lines;
 	}
+	bool get_matching_bracket(std::size_t index, std::size_t& match) const {
+		return buffer.find_matching_bracket(index, match);
+	}
+	bool get_enclosing_brackets(std::size_t index, std::size_t& open, std::size_t& close) const {
+		return buffer.find_enclosing_brackets(index, open, close);
+	}
+	bool is_read_only() const {
+		return loader || encoding == TextBuffer::Encoding::BINARY;
+	}
 	template <class F> void for_each_selection(F&& f) {
+		if (is_read_only()) {
+			return;
+		}
 		for (SelectionIterator i(this); i < selections.size(); ++i) {
 			*i += i.insertion_offset;
 			*i -= i.deletion_offset;
 			std::forward<F>(f)(i);
 		}
+		if (++edits == COMPRESS_INTERVAL) {
+			edits = 0;
+			if (buffer.get_size() >= MIN_COMPRESSED_SIZE) {
+				buffer.compress();
+			}
+		}
 	}
 	void insert_text(const char* text) {
 		for_each_selection([&](SelectionIterator& selection) {
@@ -389,14 +1621,14 @@ public:
 	void insert_newline() {
 		for_each_selection([&](SelectionIterator& selection) {
 			selection.delete_text();
-			selection.insert('\n');
-			const std::size_t line = buffer.get_info_for_index(selection->head - 1).newlines;
+			const std::size_t line = buffer.get_info_for_index(selection->head).newlines;
 			const std::size_t index = buffer.get_info_for_line_start(line).bytes;
+			std::string text("\n");
 			auto i = buffer.get_iterator(index);
-			while (i != buffer.end() && (*i == ' ' || *i == '\t')) {
-				selection.insert(*i);
-				++i;
+			for (std::size_t j = index; j < selection->head && (*i == ' ' || *i == '\t'); ++j, ++i) {
+				text.push_back(*i);
 			}
+			selection.insert(text.data(), text.size());
 		});
 	}
 	void delete_backward() {
@@ -425,6 +1657,43 @@ public:
 		const std::size_t max_index = buffer.get_info_for_line_end(line).bytes;
 		return std::min(index, max_index);
 	}
+	std::size_t get_index_for_utf16(std::size_t column, std::size_t line) const {
+		// convert a language server position with a column in utf-16 code units to a byte index
+		if (line > get_total_lines() - 1) {
+			return buffer.get_size() - 1;
+		}
+		return buffer.get_info_for_line_utf16(line, column).bytes;
+	}
+	void get_utf16_position(std::size_t index, std::size_t& column, std::size_t& line) const {
+		const auto info = buffer.get_info_for_index(index);
+		column = info.utf16_column;
+		line = info.newlines;
+	}
+	void get_indices_for_utf16(const std::size_t* columns, const std::size_t* lines, std::size_t* indices, std::size_t count) const {
+		// lookups close to the previous one are cheap, so resolve the positions in document order
+		std::vector<std::size_t> order(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](std::size_t i, std::size_t j) {
+			return lines[i] < lines[j] || (lines[i] == lines[j] && columns[i] < columns[j]);
+		});
+		for (std::size_t i: order) {
+			indices[i] = get_index_for_utf16(columns[i], lines[i]);
+		}
+	}
+	void get_utf16_positions(const std::size_t* indices, std::size_t* columns, std::size_t* lines, std::size_t count) const {
+		std::vector<std::size_t> order(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&](std::size_t i, std::size_t j) {
+			return indices[i] < indices[j];
+		});
+		for (std::size_t i: order) {
+			get_utf16_position(indices[i], columns[i], lines[i]);
+		}
+	}
 	void set_cursor(std::size_t column, std::size_t line) {
 		selections.set_selection(get_index(column, line));
 	}
@@ -545,9 +1814,66 @@ public:
 		}
 		selections.collapse(false);
 	}
+	void move_to_matching_bracket(bool extend_selection = false) {
+		for (Selection& selection: selections) {
+			std::size_t match;
+			if (buffer.find_matching_bracket(selection.head, match) || (selection.head > 0 && buffer.find_matching_bracket(selection.head - 1, match))) {
+				selection.head = match;
+			}
+			if (!extend_selection) {
+				selection.tail = selection.head;
+			}
+		}
+		selections.collapse(false);
+	}
 	void select_all() {
 		selections.set_selection(0, buffer.get_size() - 1);
 	}
+	bool find_next(const char* needle, bool ignore_case = false) {
+		// select the next match after the last selection, wrapping around at the end, the final newline is never part of a match
+		const std::size_t size = std::strlen(needle);
+		std::size_t match;
+		if (!buffer.find_next(selections.get_last_selection().max(), needle, size, ignore_case, match) || match + size >= buffer.get_size()) {
+			if (!buffer.find_next(0, needle, size, ignore_case, match) || match + size >= buffer.get_size()) {
+				return false;
+			}
+		}
+		selections.set_selection(match, match + size);
+		return true;
+	}
+	bool find_previous(const char* needle, bool ignore_case = false) {
+		// select the previous match before the last selection, wrapping around at the beginning
+		const std::size_t size = std::strlen(needle);
+		std::size_t match;
+		if (!buffer.find_previous(selections.get_last_selection().min(), needle, size, ignore_case, match) || match + size >= buffer.get_size()) {
+			// only matches that end before the final newline
+			const std::size_t end = buffer.get_size() > size ? buffer.get_size() - size : 0;
+			if (!buffer.find_previous(end, needle, size, ignore_case, match)) {
+				return false;
+			}
+		}
+		selections.set_selection(match, match + size);
+		return true;
+	}
+	std::size_t select_all_occurrences(const char* needle, bool ignore_case = false) {
+		// turn every match into a selection, the one at or after the last selection becomes the last one, returns the number of matches
+		const std::size_t size = std::strlen(needle);
+		std::vector<std::size_t> matches = buffer.find_all(needle, size, ignore_case);
+		if (!matches.empty() && matches.back() + size >= buffer.get_size()) {
+			matches.pop_back();
+		}
+		if (matches.empty()) {
+			return 0;
+		}
+		const std::size_t cursor = selections.get_last_selection().min();
+		selections.clear();
+		selections.reserve(matches.size());
+		for (std::size_t match: matches) {
+			selections.emplace_back(match, match + size);
+		}
+		selections.last_selection = std::min(selections.lower_bound(cursor + size), selections.size() - 1);
+		return matches.size();
+	}
 	const Theme& get_theme() const {
 		return prism::get_theme("one-dark");
 	}
@@ -555,20 +1881,27 @@ public:
 		std::string string;
 		auto i = selections.begin();
 		if (i != selections.end()) {
-			string.append(buffer.get_iterator(i->min()), buffer.get_iterator(i->max()));
+			buffer.append_range(string, i->min(), i->max());
 			++i;
 			while (i != selections.end()) {
 				string.push_back('\n');
-				string.append(buffer.get_iterator(i->min()), buffer.get_iterator(i->max()));
+				buffer.append_range(string, i->min(), i->max());
 				++i;
 			}
 		}
 		return string;
 	}
 	std::string cut() {
-		std::string result = copy();
+		// a buffer that can't be modified still lets the selections be copied
+		if (is_read_only()) {
+			return copy();
+		}
+		std::string result;
 		for_each_selection([&](SelectionIterator& selection) {
-			selection.delete_text();
+			if (selection.i > 0) {
+				result.push_back('\n');
+			}
+			result.append(selection.cut_text());
 		});
 		return result;
 	}
@@ -581,10 +1914,11 @@ public:
 			const char* c = text;
 			for_each_selection([&](SelectionIterator& selection) {
 				selection.delete_text();
+				const char* line = c;
 				while (*c != '\n' && *c != '\0') {
-					selection.insert(*c);
 					++c;
 				}
+				selection.insert(line, c - line);
 				if (*c == '\n') {
 					++c;
 				}
@@ -594,7 +1928,7 @@ public:
 			insert_text(text);
 		}
 	}
-	void save(const char* path) {
-		buffer.save(path);
+	bool save(const char* path) const {
+		return !loader && buffer.save(path);
 	}
 };
@@ -0,0 +1,158 @@
+// regression tests for TextBuffer and Editor
+// g++ -std=c++17 -O1 -g -fsanitize=address,undefined editor_test.cpp -o editor_test && ./editor_test
+
+#include "editor.hpp"
+#include <random>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+static const char* test;
+
+static void expect(bool condition, const char* message) {
+	if (!condition) {
+		std::fprintf(stderr, "%s: %s\n", test, message);
+		std::abort();
+	}
+}
+static std::string get_random_text(std::mt19937_64& rng, std::size_t size) {
+	// lines of random words, so that the text compresses like source code does
+	static const char* const words[] = {"if", "else", "return", "std::size_t", "index", "(", ")", "{", "}", ";", "const", "\xc3\xa4", "\xe2\x82\xac"};
+	std::string text;
+	text.reserve(size + 16);
+	while (text.size() < size) {
+		text.append(words[rng() % 13]);
+		text.push_back(rng() % 8 == 0 ? '\n' : ' ');
+	}
+	text.resize(size - 1);
+	text.push_back('\n');
+	return text;
+}
+static std::string read_file(const char* path) {
+	std::ifstream file(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void test_save_compressed() {
+	// every chunk that is queued for writing has to stay alive until it is written, even if it was decompressed and many more blocks were read since
+	test = "save compressed";
+	std::mt19937_64 rng(1);
+	const std::string text = get_random_text(rng, 20 * 1024 * 1024);
+	TextBuffer buffer;
+	buffer.insert(0, text.data(), text.size() - 1);
+	buffer.compress(0);
+	expect(buffer.get_stats().compressed > 0, "nothing was compressed");
+	const char* path = "editor_test.tmp";
+	expect(buffer.save(path), "save failed");
+	expect(read_file(path) == text, "the saved file differs");
+	std::remove(path);
+}
+
+static void test_chunks_compressed() {
+	// a reader may hold on to every chunk it got since it called get_chunk, however many blocks were decompressed for them
+	test = "chunks compressed";
+	std::mt19937_64 rng(2);
+	const std::string text = get_random_text(rng, 20 * 1024 * 1024);
+	TextBuffer buffer;
+	buffer.insert(0, text.data(), text.size() - 1);
+	buffer.compress(0);
+	expect(buffer.get_stats().compressed > 0, "nothing was compressed");
+	std::vector<Input::Chunk> chunks;
+	for (Input::Chunk chunk = buffer.get_chunk(0).first; chunk.size > 0; chunk = buffer.get_next_chunk(chunk.chunk)) {
+		chunks.push_back(chunk);
+	}
+	std::string contents;
+	for (const Input::Chunk& chunk: chunks) {
+		contents.append(chunk.data, chunk.size);
+	}
+	expect(contents == text, "the chunks differ");
+	// searching and copying read the blocks on their own
+	const std::size_t index = text.size() / 2;
+	std::string copy;
+	buffer.append_range(copy, index, text.size());
+	expect(copy == text.substr(index), "append_range");
+	std::size_t result;
+	expect(buffer.find_next(index, "return", 6, false, result) && result == text.find("return", index), "find_next");
+	expect(buffer.find_previous(index, "return", 6, false, result) && result == text.rfind("return", index - 1), "find_previous");
+	std::size_t matches = 0;
+	for (std::size_t i = text.find("std::size_t"); i != std::string::npos; i = text.find("std::size_t", i + 1)) {
+		++matches;
+	}
+	expect(buffer.find_all("std::size_t", 11, false).size() == matches, "find_all");
+}
+
+static bool find_matching_bracket(const std::string& text, std::size_t index, std::size_t& result) {
+	// the same rules by scanning, brackets of other kinds don't matter
+	static const char brackets[] = "()[]{}";
+	const char* bracket = std::strchr(brackets, text[index]);
+	if (text[index] == '\0' || !bracket) {
+		return false;
+	}
+	const std::size_t kind = (bracket - brackets) / 2;
+	const bool forward = (bracket - brackets) % 2 == 0;
+	std::ptrdiff_t depth = 0;
+	for (std::size_t i = index; forward ? i < text.size() : i != SIZE_MAX; forward ? ++i : --i) {
+		depth += (text[i] == brackets[2 * kind]) - (text[i] == brackets[2 * kind + 1]);
+		if (depth == 0) {
+			result = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void test_brackets() {
+	// the bracket summaries are built by the first query and then have to follow every kind of edit
+	test = "brackets";
+	std::mt19937_64 rng(3);
+	std::string text = get_random_text(rng, 64 * 1024);
+	TextBuffer buffer;
+	buffer.insert(0, text.data(), text.size() - 1);
+	for (std::size_t i = 0; i < 2000; ++i) {
+		const std::size_t index0 = rng() % text.size();
+		const std::size_t index1 = std::min(text.size() - 1, index0 + rng() % 64);
+		switch (rng() % 5) {
+		case 0: {
+			const std::string insertion = get_random_text(rng, 1 + rng() % 64);
+			buffer.insert(index0, insertion.data(), insertion.size());
+			text.insert(index0, insertion);
+			break;
+		}
+		case 1:
+			buffer.insert(index0, "({[]})"[i % 6]);
+			text.insert(text.begin() + index0, "({[]})"[i % 6]);
+			break;
+		case 2:
+			buffer.remove(index0, index1);
+			text.erase(index0, index1 - index0);
+			break;
+		case 3: {
+			const std::size_t index = rng() % 2 ? rng() % (index0 + 1) : index1 + rng() % (text.size() - index1);
+			buffer.move_block(index0, index1, index);
+			const std::string block = text.substr(index0, index1 - index0);
+			text.erase(index0, index1 - index0);
+			text.insert(index > index0 ? index - block.size() : index, block);
+			break;
+		}
+		case 4:
+			buffer.compress(0);
+			break;
+		}
+		for (std::size_t j = 0; j < 8; ++j) {
+			const std::size_t index = rng() % text.size();
+			std::size_t result, expected;
+			const bool found = buffer.find_matching_bracket(index, result);
+			expect(found == find_matching_bracket(text, index, expected) && (!found || result == expected), "find_matching_bracket");
+		}
+	}
+	expect(std::string(buffer.begin(), buffer.end()) == text, "the text differs");
+}
+
+int main() {
+	test_save_compressed();
+	test_chunks_compressed();
+	test_brackets();
+	std::puts("ok");
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+class LZ {
+	// a small LZ77 codec in the style of LZ4 for blocks that are decompressed far more often than they are compressed
+	// a block is a sequence of literal runs that are each followed by a match, a token byte holds the literal length in its high nibble and the match length minus 4 in its low nibble
+	// lengths of 15 and more continue in the following bytes, the last literal run has no match
+	static constexpr std::size_t MIN_MATCH = 4;
+	static constexpr std::size_t MAX_OFFSET = 0xFFFF;
+	static constexpr unsigned int HASH_BITS = 12;
+	static std::uint32_t read32(const char* data) {
+		std::uint32_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+	static std::uint32_t hash(std::uint32_t value) {
+		return (value * 2654435761u) >> (32 - HASH_BITS);
+	}
+	static char* write_length(char* out, std::size_t length) {
+		for (; length >= 255; length -= 255) {
+			*out++ = static_cast<char>(255);
+		}
+		*out++ = static_cast<char>(length);
+		return out;
+	}
+	static const char* read_length(const char* data, std::size_t& length) {
+		unsigned char byte;
+		do {
+			byte = *data++;
+			length += byte;
+		} while (byte == 255);
+		return data;
+	}
+	static char* write_sequence(char* out, const char* literals, std::size_t literals_size, std::size_t offset, std::size_t match_size) {
+		char* token = out++;
+		*token = static_cast<char>(std::min<std::size_t>(literals_size, 15) << 4);
+		if (literals_size >= 15) {
+			out = write_length(out, literals_size - 15);
+		}
+		std::memcpy(out, literals, literals_size);
+		out += literals_size;
+		if (match_size == 0) {
+			return out;
+		}
+		*out++ = static_cast<char>(offset & 0xFF);
+		*out++ = static_cast<char>(offset >> 8);
+		match_size -= MIN_MATCH;
+		*token |= static_cast<char>(std::min<std::size_t>(match_size, 15));
+		if (match_size >= 15) {
+			out = write_length(out, match_size - 15);
+		}
+		return out;
+	}
+public:
+	static constexpr std::size_t get_max_size(std::size_t size) {
+		return size + size / 255 + 16;
+	}
+	static std::size_t compress(const char* data, std::size_t size, char* out) {
+		// compress size bytes to out, which must have room for get_max_size(size) bytes, and return the compressed size
+		char* const begin = out;
+		std::uint32_t table[1 << HASH_BITS] = {};
+		std::size_t anchor = 0;
+		std::size_t i = 1;
+		while (i + MIN_MATCH <= size) {
+			const std::uint32_t value = read32(data + i);
+			const std::size_t candidate = table[hash(value)];
+			table[hash(value)] = static_cast<std::uint32_t>(i);
+			if (i - candidate > MAX_OFFSET || read32(data + candidate) != value) {
+				++i;
+				continue;
+			}
+			std::size_t match_size = MIN_MATCH;
+			while (i + match_size < size && data[candidate + match_size] == data[i + match_size]) {
+				++match_size;
+			}
+			out = write_sequence(out, data + anchor, i - anchor, i - candidate, match_size);
+			i += match_size;
+			anchor = i;
+		}
+		out = write_sequence(out, data + anchor, size - anchor, 0, 0);
+		return out - begin;
+	}
+	static void decompress(const char* data, std::size_t size, char* out) {
+		// decompress a block of size bytes to out, which must have room for the whole uncompressed block
+		const char* const end = data + size;
+		while (data < end) {
+			const unsigned char token = *data++;
+			std::size_t literals_size = token >> 4;
+			if (literals_size == 15) {
+				data = read_length(data, literals_size);
+			}
+			std::memcpy(out, data, literals_size);
+			out += literals_size;
+			data += literals_size;
+			if (data == end) {
+				break;
+			}
+			const std::size_t offset = static_cast<unsigned char>(data[0]) | static_cast<unsigned char>(data[1]) << 8;
+			data += 2;
+			std::size_t match_size = token & 15;
+			if (match_size == 15) {
+				data = read_length(data, match_size);
+			}
+			match_size += MIN_MATCH;
+			const char* match = out - offset;
+			if (offset >= match_size) {
+				std::memcpy(out, match, match_size);
+			}
+			else {
+				// the match overlaps the bytes it produces
+				for (std::size_t i = 0; i < match_size; ++i) {
+					out[i] = match[i];
+				}
+			}
+			out += match_size;
+		}
+	}
+};
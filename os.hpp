@@ -7,11 +7,17 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <dirent.h>
 #include <time.h>
 #endif
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
 #include <string>
+#include <vector>
+#include <memory>
 #include <algorithm>
 
 class Path {
@@ -330,6 +336,165 @@ public:
 	}
 };
 
+class AtomicFile {
+	// writes a file under a temporary name in the same directory and only replaces the original when everything is on disk
+	// if anything fails or commit is never called the original stays untouched and the temporary file is removed
+	std::string path;
+	std::string temporary_path;
+	bool failed;
+	#ifdef _WIN32
+	HANDLE handle;
+	#else
+	int fd;
+	// writes are collected and handed to the kernel in batches
+	static constexpr int MAX_BUFFERS = 1024;
+	struct iovec buffers[MAX_BUFFERS];
+	int buffer_count;
+	// keep the data of the buffers alive until they are written
+	std::vector<std::shared_ptr<const void>> owners;
+	bool flush() {
+		struct iovec* buffer = buffers;
+		int count = buffer_count;
+		buffer_count = 0;
+		while (count > 0) {
+			const ssize_t written = writev(fd, buffer, count);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			// skip what was written, the last buffer can be written partially
+			std::size_t rest = written;
+			while (count > 0 && rest >= buffer->iov_len) {
+				rest -= buffer->iov_len;
+				++buffer;
+				--count;
+			}
+			if (count > 0) {
+				buffer->iov_base = static_cast<char*>(buffer->iov_base) + rest;
+				buffer->iov_len -= rest;
+			}
+		}
+		owners.clear();
+		return true;
+	}
+	#endif
+public:
+	AtomicFile(const char* path): path(path), failed(false) {
+		#ifdef _WIN32
+		// a new name that no other file has, so that no existing file is truncated or removed
+		for (int i = 0; ; ++i) {
+			temporary_path = this->path + '.' + std::to_string(GetCurrentProcessId()) + '.' + std::to_string(i) + ".tmp";
+			handle = CreateFile(temporary_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle != INVALID_HANDLE_VALUE || GetLastError() != ERROR_FILE_EXISTS) break;
+		}
+		failed = handle == INVALID_HANDLE_VALUE;
+		#else
+		// replace the target of a symbolic link instead of the link
+		if (char* real_path = realpath(path, nullptr)) {
+			this->path = real_path;
+			free(real_path);
+		}
+		struct stat s;
+		const bool exists = stat(this->path.c_str(), &s) == 0;
+		buffer_count = 0;
+		for (int i = 0; ; ++i) {
+			temporary_path = this->path + '.' + std::to_string(getpid()) + '.' + std::to_string(i) + ".tmp";
+			fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, exists ? s.st_mode & 07777 : 0666);
+			if (fd != -1 || errno != EEXIST) break;
+		}
+		if (fd == -1) {
+			failed = true;
+		}
+		else if (exists) {
+			// the mode of a new file is restricted by the umask, the original mode is restored explicitly
+			failed = fchmod(fd, s.st_mode & 07777) != 0;
+			// keeping the owner requires privileges, so a failure is ignored and the file then belongs to the user who saves it
+			// the result is assigned first since a plain cast to void doesn't silence warn_unused_result
+			const int result = fchown(fd, s.st_uid, s.st_gid);
+			(void)result;
+		}
+		#endif
+	}
+	AtomicFile(const AtomicFile&) = delete;
+	~AtomicFile() {
+		#ifdef _WIN32
+		if (handle != INVALID_HANDLE_VALUE) {
+			CloseHandle(handle);
+			DeleteFile(temporary_path.c_str());
+		}
+		#else
+		if (fd != -1) {
+			close(fd);
+			unlink(temporary_path.c_str());
+		}
+		#endif
+	}
+	AtomicFile& operator =(const AtomicFile&) = delete;
+	explicit operator bool() const {
+		return !failed;
+	}
+	void write(const char* data, std::size_t size, std::shared_ptr<const void> owner = nullptr) {
+		// the data has to stay valid until commit unless an owner is given that keeps it alive, the file then holds on to the owner until the data is written
+		if (failed || size == 0) {
+			return;
+		}
+		#ifdef _WIN32
+		while (size > 0) {
+			DWORD written;
+			if (!WriteFile(handle, data, static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30)), &written, nullptr)) {
+				failed = true;
+				return;
+			}
+			data += written;
+			size -= written;
+		}
+		#else
+		if (buffer_count == MAX_BUFFERS && !flush()) {
+			failed = true;
+			return;
+		}
+		buffers[buffer_count].iov_base = const_cast<char*>(data);
+		buffers[buffer_count].iov_len = size;
+		++buffer_count;
+		if (owner) {
+			owners.push_back(std::move(owner));
+		}
+		#endif
+	}
+	bool commit() {
+		#ifdef _WIN32
+		if (failed || !FlushFileBuffers(handle)) {
+			return false;
+		}
+		CloseHandle(handle);
+		handle = INVALID_HANDLE_VALUE;
+		if (!MoveFileEx(temporary_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			DeleteFile(temporary_path.c_str());
+			return false;
+		}
+		return true;
+		#else
+		if (failed || !flush() || fsync(fd) != 0) {
+			return false;
+		}
+		const int result = close(fd);
+		fd = -1;
+		if (result != 0 || rename(temporary_path.c_str(), path.c_str()) != 0) {
+			unlink(temporary_path.c_str());
+			return false;
+		}
+		// make the rename itself durable
+		Path directory = Path(path.c_str()).parent();
+		const int directory_fd = open(directory ? directory.c_str() : ".", O_RDONLY | O_CLOEXEC);
+		if (directory_fd != -1) {
+			fsync(directory_fd);
+			close(directory_fd);
+		}
+		return true;
+		#endif
+	}
+};
+
 class Time {
 public:
 	static double get_monotonic() {
@@ -5,7 +5,16 @@
 #include <type_traits>
 #include <new>
 #include <iterator>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
 #include <cassert>
+#include "lz.hpp"
 
 template <class T, std::size_t N> class StaticVector {
 	typename std::aligned_storage<sizeof(T), alignof(T)>::type data[N];
@@ -55,7 +64,12 @@ public:
 	}
 	void insert(std::size_t index, const T& element) {
 		assert(index <= size && size < N);
-		if (index == size) {
+		if constexpr (std::is_trivially_copyable<T>::value) {
+			const T copy = element;
+			std::memmove(get_data() + index + 1, get_data() + index, (size - index) * sizeof(T));
+			new (data + index) T(copy);
+		}
+		else if (index == size) {
 			new (data + size) T(element);
 		}
 		else {
@@ -72,14 +86,48 @@ public:
 		new (data + size) T(element);
 		++size;
 	}
+	template <class Iter> void insert(std::size_t index, Iter first, std::size_t n) {
+		// insert n elements starting at first
+		assert(index <= size && size + n <= N);
+		if constexpr (std::is_trivially_copyable<T>::value && std::is_pointer<Iter>::value) {
+			std::memmove(get_data() + index + n, get_data() + index, (size - index) * sizeof(T));
+			std::copy_n(first, n, get_data() + index);
+		}
+		else {
+			for (std::size_t i = size; i > index; --i) {
+				new (data + i - 1 + n) T(std::move(get(i - 1)));
+				get(i - 1).~T();
+			}
+			for (std::size_t i = 0; i < n; ++i) {
+				new (data + index + i) T(*first);
+				++first;
+			}
+		}
+		size += n;
+	}
 	void remove(std::size_t index) {
 		assert(index < size);
 		--size;
+		if constexpr (std::is_trivially_copyable<T>::value) {
+			std::memmove(get_data() + index, get_data() + index + 1, (size - index) * sizeof(T));
+			return;
+		}
 		for (std::size_t i = index; i < size; ++i) {
 			get(i) = std::move(get(i + 1));
 		}
 		get(size).~T();
 	}
+	void remove(std::size_t index, std::size_t n) {
+		// remove n elements starting at index
+		assert(index + n <= size);
+		for (std::size_t i = index + n; i < size; ++i) {
+			get(i - n) = std::move(get(i));
+		}
+		for (std::size_t i = size - n; i < size; ++i) {
+			get(i).~T();
+		}
+		size -= n;
+	}
 	void remove() {
 		assert(size > 0);
 		--size;
@@ -165,58 +213,480 @@ inline TreeBeginComp tree_begin() {
 inline TreeEndComp tree_end() {
 	return TreeEndComp();
 }
+constexpr std::size_t get_max_tree_depth(std::size_t min_children, std::size_t n = SIZE_MAX) {
+	return n == 0 ? 0 : 1 + get_max_tree_depth(min_children, n / min_children);
+}
+
+// summary types can provide a static I::get_info(const T* data, std::size_t size) that summarizes the contents of a whole leaf at once
+template <class I, class = void> struct HasBulkInfo: std::false_type {};
+template <class I> struct HasBulkInfo<I, decltype(void(I::get_info(std::declval<const typename I::T*>(), std::size_t())))>: std::true_type {};
+
+// summary types that form a commutative group can provide an operator - so that a change of a single child is applied as a delta
+// an inverse alone is not enough, + has to be commutative as well because a leaf adds the summary of a new element to its own wherever the element was inserted
+template <class I, class = void> struct HasInverse: std::false_type {};
+template <class I> struct HasInverse<I, decltype(void(std::declval<const I&>() - std::declval<const I&>()))>: std::true_type {};
+
+// comps can provide a get_index(const I& sum, const T* data, std::size_t size) that finds their position in a leaf without folding every element
+template <class C, class I, class = void> struct HasLeafIndex: std::false_type {};
+template <class C, class I> struct HasLeafIndex<C, I, decltype(void(std::declval<const C&>().get_index(std::declval<const I&>(), std::declval<const typename I::T*>(), std::size_t())))>: std::true_type {};
 
-template <class I> class Tree {
+template <class L, class N> class HeapAllocator {
+public:
+	template <class T> void* allocate() {
+		return ::operator new(sizeof(T));
+	}
+	template <class T> void deallocate(T* node) {
+		::operator delete(node);
+	}
+	void merge(const HeapAllocator& allocator) {}
+	bool is_unique() const {
+		return false;
+	}
+};
+
+template <class L, class N> class NodePool {
+	// allocates leaves and inner nodes from large slabs
+	// the slabs are shared by all trees that can share nodes and are only released when the last of these trees is destroyed
+	static constexpr std::size_t ALIGNMENT = 64;
+	static constexpr std::size_t SLAB_SIZE = 256 * 1024;
+	static constexpr std::size_t get_slot_size(std::size_t size) {
+		return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	}
+	struct FreeList {
+		void* first = nullptr;
+		char* slab_position = nullptr;
+		char* slab_end = nullptr;
+	};
+	struct Pool {
+		std::atomic<std::size_t> references;
+		// pools are merged when trees are concatenated, the merged pool forwards to the pool that took its slabs
+		std::atomic<Pool*> forward;
+		std::mutex mutex;
+		void* slabs = nullptr;
+		FreeList leaves;
+		FreeList inodes;
+		Pool(): references(1), forward(nullptr) {}
+	};
+	Pool* pool;
+	static std::mutex& get_merge_mutex() {
+		// merges are rare, serializing them means the forwarding only changes in one place at a time
+		static std::mutex mutex;
+		return mutex;
+	}
+	static Pool* resolve(Pool* pool) {
+		while (Pool* forward = pool->forward.load(std::memory_order_acquire)) {
+			pool = forward;
+		}
+		return pool;
+	}
+	template <class F> void with_pool(F f) const {
+		// lock the pool at the end of the forwarding chain, retrying if it is merged in the meantime
+		while (true) {
+			Pool* pool = resolve(this->pool);
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			if (pool->forward.load(std::memory_order_relaxed) == nullptr) {
+				f(pool);
+				return;
+			}
+		}
+	}
+	template <class T> static FreeList& get_free_list(Pool* pool) {
+		return std::is_same<T, L>::value ? pool->leaves : pool->inodes;
+	}
+	static void release(Pool* pool) {
+		while (pool && pool->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			void* slab = pool->slabs;
+			while (slab) {
+				void* next_slab = *static_cast<void**>(slab);
+				::operator delete(slab, std::align_val_t(ALIGNMENT));
+				slab = next_slab;
+			}
+			Pool* forward = pool->forward.load(std::memory_order_acquire);
+			delete pool;
+			pool = forward;
+		}
+	}
+public:
+	NodePool(): pool(new Pool()) {}
+	NodePool(const NodePool& node_pool): pool(node_pool.pool) {
+		pool->references.fetch_add(1, std::memory_order_relaxed);
+	}
+	~NodePool() {
+		release(pool);
+	}
+	NodePool& operator =(const NodePool& node_pool) {
+		node_pool.pool->references.fetch_add(1, std::memory_order_relaxed);
+		release(pool);
+		pool = node_pool.pool;
+		return *this;
+	}
+	template <class T> void* allocate() {
+		static_assert(alignof(T) <= ALIGNMENT);
+		constexpr std::size_t size = get_slot_size(sizeof(T));
+		void* node;
+		with_pool([&](Pool* pool) {
+			FreeList& free_list = get_free_list<T>(pool);
+			if ((node = free_list.first)) {
+				free_list.first = *static_cast<void**>(node);
+				return;
+			}
+			if (free_list.slab_position + size > free_list.slab_end) {
+				char* slab = static_cast<char*>(::operator new(SLAB_SIZE, std::align_val_t(ALIGNMENT)));
+				*reinterpret_cast<void**>(slab) = pool->slabs;
+				pool->slabs = slab;
+				free_list.slab_position = slab + ALIGNMENT;
+				free_list.slab_end = slab + SLAB_SIZE;
+			}
+			node = free_list.slab_position;
+			free_list.slab_position += size;
+		});
+		return node;
+	}
+	template <class T> void deallocate(T* node) {
+		with_pool([&](Pool* pool) {
+			FreeList& free_list = get_free_list<T>(pool);
+			*reinterpret_cast<void**>(node) = free_list.first;
+			free_list.first = node;
+		});
+	}
+	void merge(const NodePool& node_pool) {
+		// make the nodes of another pool usable in the trees of this pool
+		std::lock_guard<std::mutex> merge_lock(get_merge_mutex());
+		Pool* pool = resolve(this->pool);
+		Pool* other = resolve(node_pool.pool);
+		if (pool == other) {
+			return;
+		}
+		std::scoped_lock lock(pool->mutex, other->mutex);
+		while (void* slab = other->slabs) {
+			other->slabs = *static_cast<void**>(slab);
+			*static_cast<void**>(slab) = pool->slabs;
+			pool->slabs = slab;
+		}
+		for (FreeList* free_list: {&other->leaves, &other->inodes}) {
+			FreeList& target = free_list == &other->leaves ? pool->leaves : pool->inodes;
+			while (void* node = free_list->first) {
+				free_list->first = *static_cast<void**>(node);
+				*static_cast<void**>(node) = target.first;
+				target.first = node;
+			}
+		}
+		other->leaves = FreeList();
+		other->inodes = FreeList();
+		pool->references.fetch_add(1, std::memory_order_relaxed);
+		other->forward.store(pool, std::memory_order_release);
+	}
+	bool is_unique() const {
+		return pool->forward.load(std::memory_order_acquire) == nullptr && pool->references.load(std::memory_order_acquire) == 1;
+	}
+};
+
+template <class I, template <class, class> class A = NodePool> class Tree {
 public:
 	using T = typename I::T;
+	// nodes are reference counted and can be shared between trees, a shared node is copied before it is modified
 	struct Node {
 		I info;
+		std::atomic<std::size_t> references;
+		Node(): references(1) {}
+		Node(const Node& node): info(node.info), references(1) {}
 	};
 	struct Leaf: Node {
 		static constexpr std::size_t SIZE = I::LEAF_SIZE;
 		StaticVector<T, SIZE> children;
-		Leaf* previous_leaf = nullptr;
-		Leaf* next_leaf = nullptr;
+	};
+	struct Cold {
+		// the contents of the children of a node, followed by the compressed data
+		// instead of compressed data the contents can also be a range of memory that is kept alive by owner
+		const T* external = nullptr;
+		std::shared_ptr<const void> owner;
+		// the decompressed contents while anyone still uses them, guarded by the mutex of the cache
+		mutable std::weak_ptr<const T> decompressed;
+		std::size_t size;
+		// the leaves of each child are packed evenly again when the node is modified
+		std::size_t elements[I::INODE_SIZE] = {};
+		std::size_t leaves[I::INODE_SIZE] = {};
+		Cold(std::size_t size): size(size) {}
+		std::size_t get_elements() const {
+			std::size_t n = 0;
+			for (std::size_t i = 0; i < I::INODE_SIZE; ++i) {
+				n += elements[i];
+			}
+			return n;
+		}
+		char* get_data() {
+			return reinterpret_cast<char*>(this + 1);
+		}
+		const char* get_data() const {
+			return reinterpret_cast<const char*>(this + 1);
+		}
 	};
 	struct INode: Node {
 		static constexpr std::size_t SIZE = I::INODE_SIZE;
 		StaticVector<Node*, SIZE> children;
+		// a copy of the summaries of the children so that a descent doesn't have to touch every child
+		I infos[SIZE];
+		// cold nodes keep the summaries of their children but have no children, lookups and iterators read their contents directly and only a modification creates leaves
+		std::shared_ptr<const Cold> cold;
+		// when the node was last modified, only kept up to date at COLD_DEPTH so that compress can spare the nodes that are being edited
+		std::size_t used = 0;
+		INode() {}
+		INode(const INode& node): Node(node), children(node.children) {
+			std::copy_n(node.infos, children.get_size(), infos);
+			for (Node* child: children) {
+				retain(child);
+			}
+		}
 	};
+	static constexpr std::size_t MAX_DEPTH = get_max_tree_depth(I::INODE_SIZE/2);
 
 	class Iterator {
-		Leaf* leaf;
+		// since leaves can be shared there are no links between them, instead the path from the root is stored
+		// the path ends above a leaf or above a cold node, whose whole contents the iterator then moves through at once
+		StaticVector<std::pair<const INode*, std::size_t>, MAX_DEPTH> path;
+		const Node* node;
+		const T* data;
+		std::size_t size;
+		// keeps decompressed contents alive
+		std::shared_ptr<const T> block;
 		std::size_t i;
+		// the depth of the tree, the path is shorter if it ends above a cold node
+		std::size_t depth;
+		friend class Tree;
+		void enter(const Node* node) {
+			this->node = node;
+			if (depth == path.get_size()) {
+				const Leaf* leaf = static_cast<const Leaf*>(node);
+				data = leaf->children.get_data();
+				size = leaf->children.get_size();
+				block.reset();
+			}
+			else {
+				const INode* inode = static_cast<const INode*>(node);
+				data = Tree::get_block(inode, block);
+				size = inode->cold->get_elements();
+			}
+		}
+		const Node* descend(const Node* node, bool last) {
+			// go down along the first or last children until a leaf or a cold node is reached
+			while (path.get_size() < depth) {
+				const INode* inode = static_cast<const INode*>(node);
+				if (inode->cold) {
+					break;
+				}
+				const std::size_t index = last ? inode->children.get_size() - 1 : 0;
+				path.insert({inode, index});
+				node = inode->children[index];
+			}
+			return node;
+		}
 	public:
 		using difference_type = std::ptrdiff_t;
 		using value_type = T;
 		using pointer = const T*;
 		using reference = const T&;
-		using iterator_category = std::input_iterator_tag;
-		Iterator(Leaf* leaf, std::size_t i): leaf(leaf), i(i) {}
+		using iterator_category = std::bidirectional_iterator_tag;
+		Iterator(): node(nullptr), data(nullptr), size(0), i(0), depth(0) {}
 		bool operator ==(const Iterator& rhs) const {
-			return leaf == rhs.leaf && i == rhs.i;
+			return node == rhs.node && i == rhs.i;
 		}
 		bool operator !=(const Iterator& rhs) const {
 			return !operator ==(rhs);
 		}
 		const T& operator *() const {
-			return leaf->children[i];
+			return data[i];
 		}
 		Iterator& operator ++() {
 			++i;
-			if (i == leaf->children.get_size() && leaf->next_leaf) {
-				leaf = leaf->next_leaf;
-				i = 0;
+			if (i == size) {
+				next_leaf();
+			}
+			return *this;
+		}
+		Iterator operator ++(int) {
+			Iterator iterator = *this;
+			operator ++();
+			return iterator;
+		}
+		Iterator& operator --() {
+			if (i == 0) {
+				previous_leaf();
 			}
+			--i;
 			return *this;
 		}
-		const Leaf* get_leaf() const {
-			return leaf;
+		Iterator operator --(int) {
+			Iterator iterator = *this;
+			operator --();
+			return iterator;
+		}
+		bool next_leaf() {
+			// move to the beginning of the next leaf or cold node, returns false if this is the last one
+			std::size_t level = path.get_size();
+			while (level > 0 && path[level - 1].second + 1 == path[level - 1].first->children.get_size()) {
+				--level;
+			}
+			if (level == 0) {
+				return false;
+			}
+			++path[level - 1].second;
+			path.remove(level, path.get_size() - level);
+			enter(descend(path[level - 1].first->children[path[level - 1].second], false));
+			i = 0;
+			return true;
+		}
+		bool previous_leaf() {
+			// move to the end of the previous leaf or cold node, returns false if this is the first one
+			std::size_t level = path.get_size();
+			while (level > 0 && path[level - 1].second == 0) {
+				--level;
+			}
+			if (level == 0) {
+				return false;
+			}
+			--path[level - 1].second;
+			path.remove(level, path.get_size() - level);
+			enter(descend(path[level - 1].first->children[path[level - 1].second], true));
+			i = size;
+			return true;
+		}
+		std::pair<const T*, std::size_t> get_chunk() const {
+			// the contents of the leaf or cold node the iterator is in
+			return {data, size};
+		}
+		const std::shared_ptr<const T>& get_block() const {
+			// keeps the contents of get_chunk alive if they were decompressed, empty otherwise
+			return block;
 		}
 		std::size_t get_index() const {
 			return i;
 		}
 	};
+	class ChunkIterator {
+		// iterates over the leaves and yields their contents, the end is the end of the last leaf
+		// decompressed contents are only kept alive by the iterator, so they stay valid while it is on them or while get_block is held
+		Iterator iterator;
+	public:
+		using difference_type = std::ptrdiff_t;
+		using value_type = std::pair<const T*, std::size_t>;
+		using pointer = const value_type*;
+		using reference = value_type;
+		using iterator_category = std::bidirectional_iterator_tag;
+		ChunkIterator() {}
+		ChunkIterator(const Iterator& iterator): iterator(iterator) {
+			// start at the beginning of the leaf that contains the iterator
+			if (this->iterator.i < this->iterator.size) {
+				this->iterator.i = 0;
+			}
+		}
+		bool operator ==(const ChunkIterator& rhs) const {
+			return iterator == rhs.iterator;
+		}
+		bool operator !=(const ChunkIterator& rhs) const {
+			return !operator ==(rhs);
+		}
+		value_type operator *() const {
+			return iterator.get_chunk();
+		}
+		const std::shared_ptr<const T>& get_block() const {
+			return iterator.get_block();
+		}
+		ChunkIterator& operator ++() {
+			if (!iterator.next_leaf()) {
+				iterator.i = iterator.size;
+			}
+			return *this;
+		}
+		ChunkIterator operator ++(int) {
+			ChunkIterator chunk_iterator = *this;
+			operator ++();
+			return chunk_iterator;
+		}
+		ChunkIterator& operator --() {
+			if (iterator.i == 0) {
+				iterator.previous_leaf();
+			}
+			iterator.i = 0;
+			return *this;
+		}
+		ChunkIterator operator --(int) {
+			ChunkIterator chunk_iterator = *this;
+			operator --();
+			return chunk_iterator;
+		}
+	};
+	struct Stats {
+		std::size_t leaves = 0;
+		std::size_t inodes = 0;
+		std::size_t elements = 0;
+		// the memory used by the nodes
+		std::size_t bytes = 0;
+		// the number of nodes whose children are compressed
+		std::size_t compressed = 0;
+	};
+	class Cursor {
+		// remembers the path to the last position, so lookups close to it only have to go up as far as necessary
+		Iterator iterator;
+		// the sums before the nodes on the path, the last one is the sum before the leaf
+		StaticVector<I, MAX_DEPTH + 1> sums;
+		const Node* root;
+		std::size_t version;
+		const Node* get_node(std::size_t level) const {
+			return level == 0 ? root : iterator.path[level - 1].first->children[iterator.path[level - 1].second];
+		}
+		template <class C> I seek(const Tree& tree, C comp) {
+			std::size_t level = 0;
+			if (root == tree.root && version == tree.version) {
+				// go up until the node contains comp
+				level = iterator.path.get_size();
+				while (level > 0 && (comp < sums[level] || !(comp < sums[level] + get_node(level)->info))) {
+					--level;
+				}
+			}
+			else {
+				root = tree.root;
+				version = tree.version;
+				iterator.node = nullptr;
+				iterator.depth = tree.depth;
+			}
+			I sum = level == 0 ? I() : sums[level];
+			iterator.path.remove(level, iterator.path.get_size() - level);
+			sums.remove(level, sums.get_size() - level);
+			// go down from there
+			const Node* node = get_node(level);
+			for (; level < tree.depth && !static_cast<const INode*>(node)->cold; ++level) {
+				const INode* inode = static_cast<const INode*>(node);
+				sums.insert(sum);
+				const std::size_t i = get_index(tree.depth - level, inode, sum, comp);
+				iterator.path.insert({inode, i});
+				node = inode->children[i];
+			}
+			sums.insert(sum);
+			// the contents of a cold node are only fetched again if the cursor moved to another node
+			if (iterator.node != node) {
+				iterator.enter(node);
+			}
+			if (level == tree.depth) {
+				iterator.i = get_index(0, static_cast<const Leaf*>(node), sum, comp);
+			}
+			else {
+				iterator.i = get_block_index(static_cast<const INode*>(node), iterator.data, sum, comp);
+			}
+			return sum;
+		}
+	public:
+		Cursor(): root(nullptr), version(0) {}
+		template <class C> Iterator get(const Tree& tree, C comp) {
+			seek(tree, comp);
+			return iterator;
+		}
+		template <class C> I get_sum(const Tree& tree, C comp) {
+			if (!(comp < tree.get_info())) {
+				return tree.get_info();
+			}
+			return seek(tree, comp);
+		}
+	};
 private:
 
 	static I get_info(const T& child) {
@@ -225,16 +695,27 @@ private:
 	static I get_info(Node* child) {
 		return child->info;
 	}
-	static std::size_t get_last_index(Leaf* node) {
+	static I get_info(const Leaf* node, std::size_t i) {
+		return I(node->children[i]);
+	}
+	static const I& get_info(const INode* node, std::size_t i) {
+		return node->infos[i];
+	}
+	static std::size_t get_last_index(const Leaf* node) {
 		return node->children.get_size();
 	}
-	static std::size_t get_last_index(INode* node) {
+	static std::size_t get_last_index(const INode* node) {
 		return node->children.get_size() - 1;
 	}
 	template <class N, class C> static std::size_t get_index(std::size_t depth, N* node, I& sum, C comp) {
+		if constexpr (std::is_same<typename std::remove_const<N>::type, Leaf>::value && HasLeafIndex<C, I>::value && HasBulkInfo<I>::value) {
+			const std::size_t i = comp.get_index(sum, node->children.get_data(), node->children.get_size());
+			sum = sum + I::get_info(node->children.get_data(), i);
+			return i;
+		}
 		std::size_t i;
 		for (i = 0; i < get_last_index(node); ++i) {
-			const I next_sum = sum + get_info(node->children[i]);
+			const I next_sum = sum + get_info(node, i);
 			if (comp < next_sum) break;
 			sum = next_sum;
 		}
@@ -246,83 +727,254 @@ private:
 			node->info = node->info + get_info(child);
 		}
 	}
+	static void recompute_info(std::size_t depth, INode* node) {
+		node->info = I();
+		for (std::size_t i = 0; i < node->children.get_size(); ++i) {
+			node->infos[i] = node->children[i]->info;
+			node->info = node->info + node->infos[i];
+		}
+	}
+	static void update_info(std::size_t depth, INode* node, std::size_t i) {
+		// only child i changed, its old summary is still in infos
+		if constexpr (HasInverse<I>::value) {
+			node->info = node->info - node->infos[i] + node->children[i]->info;
+			node->infos[i] = node->children[i]->info;
+		}
+		else {
+			// the other summaries are still up to date, so the children don't have to be touched
+			node->infos[i] = node->children[i]->info;
+			node->info = I();
+			for (std::size_t j = 0; j < node->children.get_size(); ++j) {
+				node->info = node->info + node->infos[j];
+			}
+		}
+	}
+	static void recompute_info(std::size_t depth, Leaf* node) {
+		if constexpr (HasBulkInfo<I>::value) {
+			node->info = I::get_info(node->children.get_data(), node->children.get_size());
+		}
+		else {
+			recompute_info<Leaf>(depth, node);
+		}
+	}
 
 	// free
-	static void free(std::size_t depth, Leaf* node) {
-		if (node->previous_leaf) node->previous_leaf->next_leaf = node->next_leaf;
-		if (node->next_leaf) node->next_leaf->previous_leaf = node->previous_leaf;
-		delete node;
+	template <class N, class... Args> N* create(Args&&... args) {
+		return new (allocator.template allocate<N>()) N(std::forward<Args>(args)...);
 	}
-	static void free(std::size_t depth, INode* node) {
-		for (Node* child: node->children) {
-			free(depth - 1, child);
+	template <class N> void destroy(N* node) {
+		node->~N();
+		allocator.deallocate(node);
+	}
+	void free(std::size_t depth, Leaf* node) {
+		destroy(node);
+	}
+	void free(std::size_t depth, INode* node) {
+		if (node->cold == nullptr) {
+			for (Node* child: node->children) {
+				release(depth - 1, child);
+			}
 		}
-		delete node;
+		destroy(node);
 	}
-	static void free(std::size_t depth, Node* node) {
+	void free(std::size_t depth, Node* node) {
 		if (depth > 0)
 			free(depth, static_cast<INode*>(node));
 		else
 			free(depth, static_cast<Leaf*>(node));
 	}
 
+	// reference counting
+	static void retain(Node* node) {
+		node->references.fetch_add(1, std::memory_order_relaxed);
+	}
+	void release(std::size_t depth, Node* node) {
+		if (node->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			free(depth, node);
+		}
+	}
+	template <class N> N* unshare(std::size_t depth, N* node) {
+		if (node->references.load(std::memory_order_acquire) == 1) {
+			return node;
+		}
+		N* copy = create<N>(*node);
+		release(depth, node);
+		return copy;
+	}
+	INode* unshare(std::size_t depth, INode* node) {
+		// the leaves of a cold node are only created before it is modified, snapshots that share it keep reading its contents
+		if (node->cold) {
+			INode* copy = thaw(node);
+			release(depth, node);
+			node = copy;
+		}
+		else {
+			node = unshare<INode>(depth, node);
+		}
+		if (depth == COLD_DEPTH) {
+			node->used = get_next_version();
+		}
+		return node;
+	}
+	Node* unshare(std::size_t depth, Node* node) {
+		if (depth > 0)
+			return unshare(depth, static_cast<INode*>(node));
+		else
+			return unshare(depth, static_cast<Leaf*>(node));
+	}
+
 	// get
-	template <class C> static Iterator get(std::size_t depth, Leaf* node, I& sum, C comp) {
-		const std::size_t i = get_index(depth, node, sum, comp);
-		return Iterator(node, i);
+	template <class C> static void get(std::size_t depth, const Leaf* node, I& sum, C comp, Iterator& iterator) {
+		iterator.enter(node);
+		iterator.i = get_index(depth, node, sum, comp);
 	}
-	template <class C> static Iterator get(std::size_t depth, INode* node, I& sum, C comp) {
+	template <class C> static void get(std::size_t depth, const INode* node, I& sum, C comp, Iterator& iterator) {
+		if (node->cold) {
+			iterator.enter(node);
+			iterator.i = get_block_index(node, iterator.data, sum, comp);
+			return;
+		}
 		const std::size_t i = get_index(depth, node, sum, comp);
-		return get(depth - 1, node->children[i], sum, comp);
+		iterator.path.insert({node, i});
+		get(depth - 1, node->children[i], sum, comp, iterator);
 	}
-	template <class C> static Iterator get(std::size_t depth, Node* node, I& sum, C comp) {
+	template <class C> static void get(std::size_t depth, const Node* node, I& sum, C comp, Iterator& iterator) {
 		if (depth > 0)
-			return get(depth, static_cast<INode*>(node), sum, comp);
+			get(depth, static_cast<const INode*>(node), sum, comp, iterator);
 		else
-			return get(depth, static_cast<Leaf*>(node), sum, comp);
+			get(depth, static_cast<const Leaf*>(node), sum, comp, iterator);
+	}
+	template <class N, class C> static std::size_t get_previous_index(std::size_t depth, N* node, I& sum, C comp) {
+		// like get_index but from the last child to the first, sum is the sum of the children after the index
+		std::size_t i;
+		for (i = node->children.get_size() - 1; i > 0; --i) {
+			const I next_sum = get_info(node, i) + sum;
+			if (comp < next_sum) break;
+			sum = next_sum;
+		}
+		return i;
+	}
+	template <class C> static void get_previous(std::size_t depth, const Leaf* node, I& sum, C comp, Iterator& iterator) {
+		iterator.enter(node);
+		iterator.i = get_previous_index(depth, node, sum, comp);
+	}
+	template <class C> static void get_previous(std::size_t depth, const INode* node, I& sum, C comp, Iterator& iterator) {
+		if (node->cold) {
+			iterator.enter(node);
+			iterator.i = get_previous_block_index(node, iterator.data, sum, comp);
+			return;
+		}
+		const std::size_t i = get_previous_index(depth, node, sum, comp);
+		iterator.path.insert({node, i});
+		get_previous(depth - 1, node->children[i], sum, comp, iterator);
+	}
+	template <class C> static void get_previous(std::size_t depth, const Node* node, I& sum, C comp, Iterator& iterator) {
+		if (depth > 0)
+			get_previous(depth, static_cast<const INode*>(node), sum, comp, iterator);
+		else
+			get_previous(depth, static_cast<const Leaf*>(node), sum, comp, iterator);
 	}
 
 	// insert
-	template <class C> static Node* insert(std::size_t depth, Leaf* node, I sum, C comp, const T& t) {
+	template <class C> Node* insert(std::size_t depth, Leaf* node, I sum, C comp, const T& t) {
 		const std::size_t index = get_index(depth, node, sum, comp);
 		node->children.insert(index, t);
 		if (node->children.get_size() == Leaf::SIZE) {
-			Leaf* next_node = new Leaf();
-			next_node->previous_leaf = node;
-			next_node->next_leaf = node->next_leaf;
-			if (node->next_leaf) node->next_leaf->previous_leaf = next_node;
-			node->next_leaf = next_node;
+			Leaf* next_node = create<Leaf>();
 			node->children.balance_out(next_node->children, Leaf::SIZE/2);
 			recompute_info(depth, node);
 			recompute_info(depth, next_node);
 			return next_node;
 		}
-		recompute_info(depth, node);
+		if constexpr (HasInverse<I>::value) {
+			node->info = node->info + I(t);
+		}
+		else {
+			recompute_info(depth, node);
+		}
 		return nullptr;
 	}
-	template <class C> static Node* insert(std::size_t depth, INode* node, I sum, C comp, const T& t) {
+	template <class C> Node* insert(std::size_t depth, INode* node, I sum, C comp, const T& t) {
 		std::size_t i = get_index(depth, node, sum, comp);
+		node->children[i] = unshare(depth - 1, node->children[i]);
 		Node* new_child = insert(depth - 1, node->children[i], sum, comp, t);
 		if (new_child) {
 			node->children.insert(i + 1, new_child);
 			if (node->children.get_size() == INode::SIZE) {
-				INode* next_node = new INode();
+				INode* next_node = create<INode>();
 				node->children.balance_out(next_node->children, INode::SIZE/2);
 				recompute_info(depth, node);
 				recompute_info(depth, next_node);
 				return next_node;
 			}
+			recompute_info(depth, node);
+			return nullptr;
 		}
-		recompute_info(depth, node);
+		update_info(depth, node, i);
 		return nullptr;
 	}
-	template <class C> static Node* insert(std::size_t depth, Node* node, I sum, C comp, const T& t) {
+	template <class C> Node* insert(std::size_t depth, Node* node, I sum, C comp, const T& t) {
 		if (depth > 0)
 			return insert(depth, static_cast<INode*>(node), sum, comp, t);
 		else
 			return insert(depth, static_cast<Leaf*>(node), sum, comp, t);
 	}
 
+	// insert range
+	template <class N, class Iter> void insert_children(std::size_t depth, N* node, std::size_t index, Iter first, std::size_t n, std::vector<Node*>& new_nodes) {
+		// insert n children at index, splitting node into as many evenly filled nodes as necessary
+		if (node->children.get_size() + n < N::SIZE) {
+			node->children.insert(index, first, n);
+			recompute_info(depth, node);
+			return;
+		}
+		decltype(node->children) head;
+		decltype(node->children) tail;
+		node->children.balance_out(tail, node->children.get_size() - index);
+		node->children.balance_out(head, index);
+		const std::size_t total = index + n + tail.get_size();
+		const std::size_t count = (total + N::SIZE - 2) / (N::SIZE - 1);
+		std::size_t h = 0;
+		std::size_t t = 0;
+		for (std::size_t i = 0; i < count; ++i) {
+			if (i > 0) {
+				N* next_node = create<N>();
+				new_nodes.push_back(next_node);
+				node = next_node;
+			}
+			std::size_t size = total / count + (i < total % count);
+			std::size_t m = std::min(size, head.get_size() - h);
+			node->children.insert(node->children.get_size(), head.get_data() + h, m);
+			h += m;
+			size -= m;
+			m = std::min(size, n);
+			node->children.insert(node->children.get_size(), first, m);
+			std::advance(first, m);
+			n -= m;
+			size -= m;
+			node->children.insert(node->children.get_size(), tail.get_data() + t, size);
+			t += size;
+			recompute_info(depth, node);
+		}
+	}
+	template <class C, class Iter> void insert(std::size_t depth, Leaf* node, I sum, C comp, Iter first, std::size_t n, std::vector<Node*>& new_nodes) {
+		const std::size_t index = get_index(depth, node, sum, comp);
+		insert_children(depth, node, index, first, n, new_nodes);
+	}
+	template <class C, class Iter> void insert(std::size_t depth, INode* node, I sum, C comp, Iter first, std::size_t n, std::vector<Node*>& new_nodes) {
+		const std::size_t i = get_index(depth, node, sum, comp);
+		std::vector<Node*> new_children;
+		node->children[i] = unshare(depth - 1, node->children[i]);
+		insert(depth - 1, node->children[i], sum, comp, first, n, new_children);
+		insert_children(depth, node, i + 1, new_children.data(), new_children.size(), new_nodes);
+	}
+	template <class C, class Iter> void insert(std::size_t depth, Node* node, I sum, C comp, Iter first, std::size_t n, std::vector<Node*>& new_nodes) {
+		if (depth > 0)
+			insert(depth, static_cast<INode*>(node), sum, comp, first, n, new_nodes);
+		else
+			insert(depth, static_cast<Leaf*>(node), sum, comp, first, n, new_nodes);
+	}
+
 	// balance
 	template <class N> static bool balance(std::size_t depth, N* left, N* right) {
 		if (left->children.get_size() + right->children.get_size() < N::SIZE) {
@@ -353,17 +1005,13 @@ private:
 	}
 
 	// append
-	template <class Iter> static Node* append(std::size_t depth, Leaf* node, Iter& first, Iter last) {
+	template <class Iter> Node* append(std::size_t depth, Leaf* node, Iter& first, Iter last) {
 		while (node->children.get_size() < Leaf::SIZE && first != last) {
 			node->children.insert(*first);
 			++first;
 		}
 		if (node->children.get_size() == Leaf::SIZE) {
-			Leaf* next_node = new Leaf();
-			next_node->previous_leaf = node;
-			next_node->next_leaf = node->next_leaf;
-			if (node->next_leaf) node->next_leaf->previous_leaf = next_node;
-			node->next_leaf = next_node;
+			Leaf* next_node = create<Leaf>();
 			node->children.balance_out(next_node->children, 1);
 			while (next_node->children.get_size() < Leaf::SIZE - 1 && first != last) {
 				next_node->children.insert(*first);
@@ -379,13 +1027,14 @@ private:
 		recompute_info(depth, node);
 		return nullptr;
 	}
-	template <class Iter> static Node* append(std::size_t depth, INode* node, Iter& first, Iter last) {
+	template <class Iter> Node* append(std::size_t depth, INode* node, Iter& first, Iter last) {
+		node->children.get() = unshare(depth - 1, node->children.get());
 		while (node->children.get_size() < INode::SIZE && first != last) {
 			Node* new_child = append(depth - 1, node->children.get(), first, last);
 			if (new_child) node->children.insert(new_child);
 		}
 		if (node->children.get_size() == INode::SIZE) {
-			INode* next_node = new INode();
+			INode* next_node = create<INode>();
 			node->children.balance_out(next_node->children, 1);
 			while (next_node->children.get_size() < INode::SIZE - 1 && first != last) {
 				Node* new_child = append(depth - 1, next_node->children.get(), first, last);
@@ -401,7 +1050,7 @@ private:
 		recompute_info(depth, node);
 		return nullptr;
 	}
-	template <class Iter> static Node* append(std::size_t depth, Node* node, Iter& first, Iter last) {
+	template <class Iter> Node* append(std::size_t depth, Node* node, Iter& first, Iter last) {
 		if (depth > 0)
 			return append(depth, static_cast<INode*>(node), first, last);
 		else
@@ -409,91 +1058,1187 @@ private:
 	}
 
 	// remove
-	template <class C> static bool remove(std::size_t depth, Leaf* node, I sum, C comp) {
+	template <class C> bool remove(std::size_t depth, Leaf* node, I sum, C comp) {
 		const std::size_t i = get_index(depth, node, sum, comp);
+		if constexpr (HasInverse<I>::value) {
+			node->info = node->info - I(node->children[i]);
+		}
 		node->children.remove(i);
-		recompute_info(depth, node);
+		if constexpr (!HasInverse<I>::value) {
+			recompute_info(depth, node);
+		}
 		return node->children.get_size() < Leaf::SIZE/2;
 	}
-	template <class C> static bool remove(std::size_t depth, INode* node, I sum, C comp) {
+	template <class C> bool remove(std::size_t depth, INode* node, I sum, C comp) {
 		std::size_t i = get_index(depth, node, sum, comp);
+		node->children[i] = unshare(depth - 1, node->children[i]);
 		if (remove(depth - 1, node->children[i], sum, comp)) {
 			if (i == 0) ++i;
 			assert(i < node->children.get_size());
+			node->children[i - 1] = unshare(depth - 1, node->children[i - 1]);
+			node->children[i] = unshare(depth - 1, node->children[i]);
 			if (balance(depth - 1, node->children[i - 1], node->children[i])) {
-				free(depth - 1, node->children[i]);
+				release(depth - 1, node->children[i]);
 				node->children.remove(i);
 			}
+			recompute_info(depth, node);
+		}
+		else {
+			update_info(depth, node, i);
 		}
-		recompute_info(depth, node);
 		return node->children.get_size() < INode::SIZE/2;
 	}
-	template <class C> static bool remove(std::size_t depth, Node* node, I sum, C comp) {
+	template <class C> bool remove(std::size_t depth, Node* node, I sum, C comp) {
 		if (depth > 0)
 			return remove(depth, static_cast<INode*>(node), sum, comp);
 		else
 			return remove(depth, static_cast<Leaf*>(node), sum, comp);
 	}
 
+	// remove range
+	template <class C0, class C1> bool remove(std::size_t depth, Leaf* node, I sum, C0 begin, C1 end) {
+		I sum_end = sum;
+		const std::size_t i = get_index(depth, node, sum, begin);
+		const std::size_t j = get_index(depth, node, sum_end, end);
+		node->children.remove(i, j - i);
+		recompute_info(depth, node);
+		return node->children.get_size() == 0;
+	}
+	template <class C0, class C1> bool remove(std::size_t depth, INode* node, I sum, C0 begin, C1 end) {
+		I sum_end = sum;
+		const std::size_t i = get_index(depth, node, sum, begin);
+		const std::size_t j = get_index(depth, node, sum_end, end);
+		node->children[i] = unshare(depth - 1, node->children[i]);
+		node->children[j] = unshare(depth - 1, node->children[j]);
+		if (i == j) {
+			if (remove(depth - 1, node->children[i], sum, begin, end)) {
+				release(depth - 1, node->children[i]);
+				node->children.remove(i);
+			}
+		}
+		else {
+			// the children between i and j are removed completely
+			std::size_t first = i + 1;
+			std::size_t last = j;
+			if (remove(depth - 1, node->children[j], sum_end, begin, end)) {
+				++last;
+			}
+			if (remove(depth - 1, node->children[i], sum, begin, end)) {
+				--first;
+			}
+			for (std::size_t k = first; k < last; ++k) {
+				release(depth - 1, node->children[k]);
+			}
+			node->children.remove(first, last - first);
+		}
+		recompute_info(depth, node);
+		return node->children.get_size() == 0;
+	}
+	template <class C0, class C1> bool remove(std::size_t depth, Node* node, I sum, C0 begin, C1 end) {
+		if (depth > 0)
+			return remove(depth, static_cast<INode*>(node), sum, begin, end);
+		else
+			return remove(depth, static_cast<Leaf*>(node), sum, begin, end);
+	}
+
+	// repair
+	static bool is_underfull(std::size_t depth, Node* node) {
+		if (depth > 0)
+			return static_cast<INode*>(node)->children.get_size() < INode::SIZE/2;
+		else
+			return static_cast<Leaf*>(node)->children.get_size() < Leaf::SIZE/2;
+	}
+	template <class C> bool repair(std::size_t depth, INode* node, I sum, C comp) {
+		// after a range removal only the nodes left and right of comp can underflow
+		bool changed = false;
+		while (node->children.get_size() > 1) {
+			I child_sum = sum;
+			std::size_t i = get_index(depth, node, child_sum, comp);
+			if (i > 0 && is_underfull(depth - 1, node->children[i - 1])) {
+				--i;
+			}
+			else if (!is_underfull(depth - 1, node->children[i])) {
+				break;
+			}
+			if (i + 1 == node->children.get_size()) {
+				--i;
+			}
+			node->children[i] = unshare(depth - 1, node->children[i]);
+			node->children[i + 1] = unshare(depth - 1, node->children[i + 1]);
+			if (balance(depth - 1, node->children[i], node->children[i + 1])) {
+				release(depth - 1, node->children[i + 1]);
+				node->children.remove(i + 1);
+			}
+			// the sum of the node stays the same but the copies of the child summaries change
+			recompute_info(depth, node);
+			changed = true;
+		}
+		if (depth > 1) {
+			I previous_sum = sum;
+			const std::size_t i = get_index(depth, node, sum, comp);
+			if (i > 0) {
+				for (std::size_t k = 0; k < i - 1; ++k) {
+					previous_sum = previous_sum + get_info(node->children[k]);
+				}
+				node->children[i - 1] = unshare(depth - 1, node->children[i - 1]);
+				changed |= repair(depth - 1, static_cast<INode*>(node->children[i - 1]), previous_sum, comp);
+			}
+			node->children[i] = unshare(depth - 1, node->children[i]);
+			changed |= repair(depth - 1, static_cast<INode*>(node->children[i]), sum, comp);
+		}
+		return changed;
+	}
+
+	// join
+	Node* split_if_full(std::size_t depth, INode* node) {
+		if (node->children.get_size() == INode::SIZE) {
+			INode* next_node = create<INode>();
+			node->children.balance_out(next_node->children, INode::SIZE/2);
+			recompute_info(depth, node);
+			recompute_info(depth, next_node);
+			return next_node;
+		}
+		recompute_info(depth, node);
+		return nullptr;
+	}
+	void balance_children(std::size_t depth, INode* node, std::size_t i) {
+		// balance the children i and i + 1 if one of them is the (possibly underfull) root of another tree
+		if (is_underfull(depth - 1, node->children[i]) || is_underfull(depth - 1, node->children[i + 1])) {
+			node->children[i] = unshare(depth - 1, node->children[i]);
+			node->children[i + 1] = unshare(depth - 1, node->children[i + 1]);
+			if (balance(depth - 1, node->children[i], node->children[i + 1])) {
+				release(depth - 1, node->children[i + 1]);
+				node->children.remove(i + 1);
+			}
+		}
+	}
+	Node* join_right(std::size_t depth, INode* node, std::size_t right_depth, Node* right) {
+		// append the tree right to the right edge of node
+		if (depth == right_depth + 1) {
+			node->children.insert(right);
+			balance_children(depth, node, node->children.get_size() - 2);
+		}
+		else {
+			node->children.get() = unshare(depth - 1, node->children.get());
+			Node* new_child = join_right(depth - 1, static_cast<INode*>(node->children.get()), right_depth, right);
+			if (new_child) node->children.insert(new_child);
+		}
+		return split_if_full(depth, node);
+	}
+	Node* join_left(std::size_t depth, INode* node, std::size_t left_depth, Node* left) {
+		// prepend the tree left to the left edge of node
+		if (depth == left_depth + 1) {
+			node->children.insert(0, left);
+			balance_children(depth, node, 0);
+		}
+		else {
+			node->children[0] = unshare(depth - 1, node->children[0]);
+			Node* new_child = join_left(depth - 1, static_cast<INode*>(node->children[0]), left_depth, left);
+			if (new_child) node->children.insert(1, new_child);
+		}
+		return split_if_full(depth, node);
+	}
+
+	// split
+	template <class C> void split(std::size_t depth, Leaf* node, I sum, C comp, Tree& left, Tree& right) {
+		const std::size_t i = get_index(depth, node, sum, comp);
+		Leaf* right_node = create<Leaf>();
+		node->children.balance_out(right_node->children, node->children.get_size() - i);
+		recompute_info(depth, node);
+		recompute_info(depth, right_node);
+		left = Tree(allocator, depth, node);
+		right = Tree(allocator, depth, right_node);
+	}
+	template <class C> void split(std::size_t depth, INode* node, I sum, C comp, Tree& left, Tree& right) {
+		const std::size_t i = get_index(depth, node, sum, comp);
+		INode* right_node = create<INode>();
+		node->children.balance_out(right_node->children, node->children.get_size() - i - 1);
+		Node* child = unshare(depth - 1, node->children.get());
+		node->children.remove();
+		recompute_info(depth, node);
+		recompute_info(depth, right_node);
+		Tree child_left(allocator);
+		Tree child_right(allocator);
+		split(depth - 1, child, sum, comp, child_left, child_right);
+		left = Tree(allocator, depth, node);
+		left.concat(std::move(child_left));
+		right = std::move(child_right);
+		right.concat(Tree(allocator, depth, right_node));
+	}
+	template <class C> void split(std::size_t depth, Node* node, I sum, C comp, Tree& left, Tree& right) {
+		if (depth > 0)
+			split(depth, static_cast<INode*>(node), sum, comp, left, right);
+		else
+			split(depth, static_cast<Leaf*>(node), sum, comp, left, right);
+	}
+
+	// check
+	template <class N> static bool check_node(const N* node, bool is_root) {
+		const std::size_t size = node->children.get_size();
+		if (size >= N::SIZE || (!is_root && size < N::SIZE/2) || node->references.load(std::memory_order_relaxed) == 0) {
+			return false;
+		}
+		I info;
+		for (const auto& child: node->children) {
+			info = info + get_info(child);
+		}
+		return info == node->info;
+	}
+	static bool check(std::size_t depth, const Leaf* node, bool is_root) {
+		return check_node(node, is_root);
+	}
+	static bool check(std::size_t depth, const INode* node, bool is_root) {
+		if (node->cold) {
+			return check_cold(depth, node, is_root);
+		}
+		if (!check_node(node, is_root) || (is_root && node->children.get_size() < 2)) {
+			return false;
+		}
+		for (std::size_t i = 0; i < node->children.get_size(); ++i) {
+			if (!(node->infos[i] == node->children[i]->info) || !check(depth - 1, node->children[i], false)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	static bool check_cold(std::size_t depth, const INode* node, bool is_root) {
+		// the summaries of a cold node have to match its contents and its children have to be valid once they are created
+		const Cold* cold = node->cold.get();
+		const std::size_t size = node->children.get_size();
+		if (depth != COLD_DEPTH || size >= INode::SIZE || (!is_root && size < INode::SIZE/2) || (is_root && size < 2) || node->references.load(std::memory_order_relaxed) == 0) {
+			return false;
+		}
+		std::shared_ptr<const T> block;
+		const T* data = get_block(node, block);
+		I info;
+		for (std::size_t i = 0; i < size; ++i) {
+			const std::size_t leaves = cold->leaves[i];
+			if (node->children[i] != nullptr || leaves >= INode::SIZE || leaves < INode::SIZE/2 || cold->elements[i] >= leaves * (Leaf::SIZE - 1) + 1 || cold->elements[i] < leaves * (Leaf::SIZE/2)) {
+				return false;
+			}
+			if (!(get_range_info(data, cold->elements[i]) == node->infos[i])) {
+				return false;
+			}
+			info = info + node->infos[i];
+			data += cold->elements[i];
+		}
+		return info == node->info;
+	}
+	static bool check(std::size_t depth, const Node* node, bool is_root) {
+		if (depth > 0)
+			return check(depth, static_cast<const INode*>(node), is_root);
+		else
+			return check(depth, static_cast<const Leaf*>(node), is_root);
+	}
+
+	// bulk load
+	static constexpr std::size_t MIN_ELEMENTS_PER_THREAD = 1 << 22;
+	void create_leaves(const T* first, std::size_t n, std::vector<Node*>& nodes, std::size_t begin, std::size_t end) {
+		// create the leaves begin to end of n elements that are packed evenly into nodes.size() leaves
+		const std::size_t size = n / nodes.size();
+		const std::size_t remainder = n % nodes.size();
+		first += begin * size + std::min(begin, remainder);
+		for (std::size_t i = begin; i < end; ++i) {
+			Leaf* leaf = create<Leaf>();
+			leaf->children.insert(0, first, size + (i < remainder));
+			recompute_info(0, leaf);
+			nodes[i] = leaf;
+			first += size + (i < remainder);
+		}
+	}
+	static std::size_t get_offset(std::size_t count, std::size_t parts, std::size_t i) {
+		// the first of count items that are split evenly into parts that goes to part i
+		return i * (count / parts) + std::min(i, count % parts);
+	}
+	static I get_range_info(const T* first, std::size_t n) {
+		if constexpr (HasBulkInfo<I>::value) {
+			return I::get_info(first, n);
+		}
+		I info;
+		for (std::size_t i = 0; i < n; ++i) {
+			info = info + I(first[i]);
+		}
+		return info;
+	}
+	void create_external_nodes(const T* first, std::size_t n, const std::shared_ptr<const void>& owner, std::size_t parents, std::vector<Node*>& nodes, std::size_t begin, std::size_t end) {
+		// create the nodes begin to end at COLD_DEPTH on top of n elements that stay in place, only the summaries of their children are computed
+		const std::size_t leaves = (n + Leaf::SIZE - 2) / (Leaf::SIZE - 1);
+		for (std::size_t i = begin; i < end; ++i) {
+			INode* node = create<INode>();
+			std::shared_ptr<Cold> cold = allocate_cold(0);
+			const std::size_t first_parent = get_offset(parents, nodes.size(), i);
+			const std::size_t last_parent = get_offset(parents, nodes.size(), i + 1);
+			for (std::size_t j = first_parent; j < last_parent; ++j) {
+				const std::size_t first_leaf = get_offset(leaves, parents, j);
+				const std::size_t last_leaf = get_offset(leaves, parents, j + 1);
+				const std::size_t offset = get_offset(n, leaves, first_leaf);
+				cold->elements[j - first_parent] = get_offset(n, leaves, last_leaf) - offset;
+				cold->leaves[j - first_parent] = last_leaf - first_leaf;
+				node->children.insert(nullptr);
+				node->infos[j - first_parent] = get_range_info(first + offset, cold->elements[j - first_parent]);
+				node->info = node->info + node->infos[j - first_parent];
+			}
+			cold->external = first + get_offset(n, leaves, get_offset(leaves, parents, first_parent));
+			cold->owner = owner;
+			node->cold = cold;
+			nodes[i] = node;
+		}
+	}
+	static Node* create_inner_nodes(A<Leaf, INode>& allocator, std::vector<Node*>& nodes, std::size_t& depth) {
+		// build the inner levels bottom-up on top of the nodes at the given depth and return the root, depth becomes the depth of the root
+		while (nodes.size() > 1) {
+			++depth;
+			const std::size_t count = (nodes.size() + INode::SIZE - 2) / (INode::SIZE - 1);
+			Node** children = nodes.data();
+			for (std::size_t i = 0; i < count; ++i) {
+				const std::size_t size = nodes.size() / count + (i < nodes.size() % count);
+				INode* inode = new (allocator.template allocate<INode>()) INode();
+				inode->children.insert(0, children, size);
+				recompute_info(depth, inode);
+				nodes[i] = inode;
+				children += size;
+			}
+			nodes.resize(count);
+		}
+		return nodes[0];
+	}
+
+	// stats
+	static void get_stats(std::size_t depth, const Node* node, Stats& stats) {
+		if (depth > 0) {
+			const INode* inode = static_cast<const INode*>(node);
+			++stats.inodes;
+			stats.bytes += sizeof(INode);
+			if (inode->cold) {
+				stats.bytes += sizeof(Cold) + inode->cold->size;
+				++stats.compressed;
+				stats.elements += inode->cold->get_elements();
+				return;
+			}
+			for (const Node* child: inode->children) {
+				get_stats(depth - 1, child, stats);
+			}
+		}
+		else {
+			++stats.leaves;
+			stats.bytes += sizeof(Leaf);
+			stats.elements += static_cast<const Leaf*>(node)->children.get_size();
+		}
+	}
+
+	// compress
+	// nodes at this depth are compressed as a whole, so a compressed node holds about 144 leaves
+	static constexpr std::size_t COLD_DEPTH = 2;
+	struct Cache {
+		// the most recently used decompressed contents, so that moving around a compressed part doesn't decompress it again every time
+		// this only saves work, the contents stay alive as long as an iterator or a reader holds their block
+		static constexpr std::size_t SIZE = 32;
+		std::mutex mutex;
+		std::shared_ptr<const T> blocks[SIZE];
+		void use(const std::shared_ptr<const T>& block) {
+			// move block to the front, the least recently used one drops out at the back
+			std::size_t i = 0;
+			while (i + 1 < SIZE && blocks[i] != block) {
+				++i;
+			}
+			std::rotate(blocks, blocks + i, blocks + i + 1);
+			blocks[0] = block;
+		}
+	};
+	static Cache& get_cache() {
+		static Cache cache;
+		return cache;
+	}
+	static const T* get_block(const INode* node, std::shared_ptr<const T>& block) {
+		// the contents of a cold node, decompressed contents are kept alive by block
+		const Cold* cold = node->cold.get();
+		if (cold->external) {
+			block.reset();
+			return cold->external;
+		}
+		Cache& cache = get_cache();
+		{
+			std::lock_guard<std::mutex> lock(cache.mutex);
+			block = cold->decompressed.lock();
+			if (block) {
+				cache.use(block);
+				return block.get();
+			}
+		}
+		// other threads can read other nodes in the meantime
+		auto data = std::make_shared<std::vector<T>>(cold->get_elements());
+		LZ::decompress(cold->get_data(), cold->size, reinterpret_cast<char*>(data->data()));
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		block = cold->decompressed.lock();
+		if (!block) {
+			block = std::shared_ptr<const T>(data, data->data());
+			cold->decompressed = block;
+		}
+		cache.use(block);
+		return block.get();
+	}
+	static std::size_t get_leaf_size(const Cold* cold, std::size_t i, std::size_t j) {
+		// the size of leaf j of child i once the node is modified
+		return cold->elements[i] / cold->leaves[i] + (j < cold->elements[i] % cold->leaves[i]);
+	}
+	template <class C> static std::size_t get_index(const T* data, std::size_t size, I& sum, C comp) {
+		// like get_index for a leaf but for a range of the contents of a cold node
+		if constexpr (HasLeafIndex<C, I>::value && HasBulkInfo<I>::value) {
+			const std::size_t i = comp.get_index(sum, data, size);
+			sum = sum + I::get_info(data, i);
+			return i;
+		}
+		std::size_t i;
+		for (i = 0; i < size; ++i) {
+			const I next_sum = sum + I(data[i]);
+			if (comp < next_sum) break;
+			sum = next_sum;
+		}
+		return i;
+	}
+	template <class C> static std::size_t get_previous_index(const T* data, std::size_t size, I& sum, C comp) {
+		std::size_t i;
+		for (i = size - 1; i > 0; --i) {
+			const I next_sum = I(data[i]) + sum;
+			if (comp < next_sum) break;
+			sum = next_sum;
+		}
+		return i;
+	}
+	template <class C> static std::size_t get_block_index(const INode* node, const T* data, I& sum, C comp) {
+		// the summaries of the children narrow the search down to one child, then the summaries of the leaves it would have to one leaf
+		const Cold* cold = node->cold.get();
+		const std::size_t i = get_index(COLD_DEPTH, node, sum, comp);
+		std::size_t offset = 0;
+		for (std::size_t j = 0; j < i; ++j) {
+			offset += cold->elements[j];
+		}
+		std::size_t j = 0;
+		for (; j + 1 < cold->leaves[i]; ++j) {
+			const I next_sum = sum + get_range_info(data + offset, get_leaf_size(cold, i, j));
+			if (comp < next_sum) break;
+			sum = next_sum;
+			offset += get_leaf_size(cold, i, j);
+		}
+		return offset + get_index(data + offset, get_leaf_size(cold, i, j), sum, comp);
+	}
+	template <class C> static std::size_t get_previous_block_index(const INode* node, const T* data, I& sum, C comp) {
+		const Cold* cold = node->cold.get();
+		const std::size_t i = get_previous_index(COLD_DEPTH, node, sum, comp);
+		std::size_t end = 0;
+		for (std::size_t j = 0; j <= i; ++j) {
+			end += cold->elements[j];
+		}
+		std::size_t j = cold->leaves[i] - 1;
+		for (; j > 0; --j) {
+			const I next_sum = get_range_info(data + end - get_leaf_size(cold, i, j), get_leaf_size(cold, i, j)) + sum;
+			if (comp < next_sum) break;
+			sum = next_sum;
+			end -= get_leaf_size(cold, i, j);
+		}
+		const std::size_t size = get_leaf_size(cold, i, j);
+		return end - size + get_previous_index(data + end - size, size, sum, comp);
+	}
+	template <class C> static bool find_next_in_block(const INode* node, const T* data, std::size_t& index, I& sum, C comp) {
+		// like find_next within the contents of a cold node, whole children and leaves after index are skipped by their summaries
+		const Cold* cold = node->cold.get();
+		std::size_t offset = 0;
+		for (std::size_t i = 0; i < node->children.get_size(); offset += cold->elements[i], ++i) {
+			if (offset + cold->elements[i] <= index) {
+				continue;
+			}
+			if (offset >= index) {
+				const I next_sum = sum + node->infos[i];
+				if (!(comp < next_sum)) {
+					sum = next_sum;
+					continue;
+				}
+			}
+			std::size_t first = offset;
+			for (std::size_t j = 0; j < cold->leaves[i]; first += get_leaf_size(cold, i, j), ++j) {
+				const std::size_t last = first + get_leaf_size(cold, i, j);
+				if (last <= index) {
+					continue;
+				}
+				if (first >= index) {
+					const I next_sum = sum + get_range_info(data + first, last - first);
+					if (!(comp < next_sum)) {
+						sum = next_sum;
+						continue;
+					}
+				}
+				for (std::size_t k = std::max(first, index); k < last; ++k) {
+					const I next_sum = sum + I(data[k]);
+					if (comp < next_sum) {
+						index = k;
+						return true;
+					}
+					sum = next_sum;
+				}
+			}
+		}
+		return false;
+	}
+	template <class C> static bool find_previous_in_block(const INode* node, const T* data, std::size_t& index, I& sum, C comp) {
+		const Cold* cold = node->cold.get();
+		std::size_t end = cold->get_elements();
+		for (std::size_t i = node->children.get_size(); i > 0; end -= cold->elements[i - 1], --i) {
+			const std::size_t offset = end - cold->elements[i - 1];
+			if (offset >= index) {
+				continue;
+			}
+			if (end <= index) {
+				const I next_sum = node->infos[i - 1] + sum;
+				if (!(comp < next_sum)) {
+					sum = next_sum;
+					continue;
+				}
+			}
+			std::size_t last = end;
+			for (std::size_t j = cold->leaves[i - 1]; j > 0; last -= get_leaf_size(cold, i - 1, j - 1), --j) {
+				const std::size_t first = last - get_leaf_size(cold, i - 1, j - 1);
+				if (first >= index) {
+					continue;
+				}
+				if (last <= index) {
+					const I next_sum = get_range_info(data + first, last - first) + sum;
+					if (!(comp < next_sum)) {
+						sum = next_sum;
+						continue;
+					}
+				}
+				for (std::size_t k = std::min(last, index); k > first; --k) {
+					const I next_sum = I(data[k - 1]) + sum;
+					if (comp < next_sum) {
+						index = k - 1;
+						return true;
+					}
+					sum = next_sum;
+				}
+			}
+		}
+		return false;
+	}
+	INode* thaw(const INode* node) {
+		// create the leaves of a cold node, packed the way they were when it was compressed
+		std::shared_ptr<const T> block;
+		const T* first = get_block(node, block);
+		const Cold* cold = node->cold.get();
+		INode* copy = create<INode>();
+		for (std::size_t i = 0; i < node->children.get_size(); ++i) {
+			INode* child = create<INode>();
+			for (std::size_t j = 0; j < cold->leaves[i]; ++j) {
+				const std::size_t size = get_leaf_size(cold, i, j);
+				Leaf* leaf = create<Leaf>();
+				leaf->children.insert(0, first, size);
+				recompute_info(0, leaf);
+				child->children.insert(leaf);
+				first += size;
+			}
+			recompute_info(COLD_DEPTH - 1, child);
+			copy->children.insert(child);
+		}
+		recompute_info(COLD_DEPTH, copy);
+		return copy;
+	}
+	static std::shared_ptr<Cold> allocate_cold(std::size_t size) {
+		// the compressed data follows the struct in the same allocation
+		return std::shared_ptr<Cold>(new (::operator new(sizeof(Cold) + size)) Cold(size), [](Cold* cold) {
+			cold->~Cold();
+			::operator delete(cold);
+		});
+	}
+	static std::shared_ptr<Cold> create_cold(const INode* node) {
+		std::vector<T> data;
+		std::size_t elements[INode::SIZE];
+		std::size_t leaves[INode::SIZE];
+		for (std::size_t i = 0; i < node->children.get_size(); ++i) {
+			const INode* child = static_cast<const INode*>(node->children[i]);
+			elements[i] = 0;
+			leaves[i] = child->children.get_size();
+			for (const Node* leaf: child->children) {
+				const auto& children = static_cast<const Leaf*>(leaf)->children;
+				data.insert(data.end(), children.begin(), children.end());
+				elements[i] += children.get_size();
+			}
+		}
+		const char* bytes = reinterpret_cast<const char*>(data.data());
+		std::vector<char> compressed(LZ::get_max_size(data.size() * sizeof(T)));
+		const std::size_t size = LZ::compress(bytes, data.size() * sizeof(T), compressed.data());
+		std::shared_ptr<Cold> cold = allocate_cold(size);
+		std::copy_n(elements, node->children.get_size(), cold->elements);
+		std::copy_n(leaves, node->children.get_size(), cold->leaves);
+		std::memcpy(cold->get_data(), compressed.data(), size);
+		return cold;
+	}
+	static void get_used(std::size_t depth, const INode* node, std::vector<std::size_t>& used) {
+		// collect when the nodes that were modified since they were built were last modified
+		for (const Node* child: node->children) {
+			const INode* inode = static_cast<const INode*>(child);
+			if (depth - 1 > COLD_DEPTH) {
+				get_used(depth - 1, inode, used);
+			}
+			else if (inode->cold == nullptr && inode->used > 0) {
+				used.push_back(inode->used);
+			}
+		}
+	}
+	void compress(std::size_t depth, INode* node, std::size_t min_used) {
+		for (Node*& child: node->children) {
+			if (depth - 1 > COLD_DEPTH) {
+				child = unshare(depth - 1, child);
+				compress(depth - 1, static_cast<INode*>(child), min_used);
+				continue;
+			}
+			const INode* inode = static_cast<const INode*>(child);
+			if (inode->cold || inode->used >= min_used) {
+				continue;
+			}
+			// the new node replaces the old one instead of changing it in place since the old one might be shared
+			INode* cold_node = create<INode>();
+			cold_node->cold = create_cold(inode);
+			for (std::size_t i = 0; i < inode->children.get_size(); ++i) {
+				cold_node->children.insert(nullptr);
+				cold_node->infos[i] = inode->infos[i];
+			}
+			cold_node->info = inode->info;
+			release(depth - 1, child);
+			child = cold_node;
+		}
+	}
+	static void release_cold(std::size_t depth, INode* node) {
+		// when the nodes are dropped together with their allocator only the contents of cold nodes have to be released
+		if (depth == COLD_DEPTH) {
+			node->cold.reset();
+			return;
+		}
+		for (Node* child: node->children) {
+			release_cold(depth - 1, static_cast<INode*>(child));
+		}
+	}
+
+	// compact
+	static void get_subtrees(std::size_t depth, const Node* node, std::vector<const INode*>& subtrees) {
+		// collect the nodes at COLD_DEPTH in order
+		const INode* inode = static_cast<const INode*>(node);
+		if (depth == COLD_DEPTH) {
+			subtrees.push_back(inode);
+			return;
+		}
+		for (const Node* child: inode->children) {
+			get_subtrees(depth - 1, child, subtrees);
+		}
+	}
+	static bool get_subtree_sizes(std::size_t n, std::size_t (&sizes)[COLD_DEPTH + 1]) {
+		// the fewest nodes per level, from the leaves up, that n elements can be packed into as subtrees of depth COLD_DEPTH that are not underfull
+		// returns false if n elements are too few for that
+		std::size_t capacity = Leaf::SIZE - 1;
+		for (std::size_t d = 1; d <= COLD_DEPTH; ++d) {
+			capacity *= INode::SIZE - 1;
+		}
+		sizes[COLD_DEPTH] = std::max<std::size_t>(1, (n + capacity - 1) / capacity);
+		for (std::size_t d = COLD_DEPTH; d > 0; --d) {
+			capacity /= INode::SIZE - 1;
+			sizes[d - 1] = std::max(sizes[d] * (INode::SIZE/2), (n + capacity - 1) / capacity);
+		}
+		return sizes[0] * (Leaf::SIZE/2) <= n;
+	}
+	static void create_subtrees(A<Leaf, INode>& allocator, const T* first, std::size_t n, std::vector<Node*>& nodes) {
+		// pack n elements into nearly full subtrees of depth COLD_DEPTH that can be placed next to any other nodes at COLD_DEPTH
+		std::size_t sizes[COLD_DEPTH + 1];
+		get_subtree_sizes(n, sizes);
+		std::vector<Node*> level;
+		create_leaves(allocator, first, n, sizes[0], level);
+		for (std::size_t d = 1; d <= COLD_DEPTH; ++d) {
+			std::vector<Node*> parents(sizes[d]);
+			for (std::size_t i = 0; i < parents.size(); ++i) {
+				INode* inode = new (allocator.template allocate<INode>()) INode();
+				const std::size_t begin = get_offset(level.size(), parents.size(), i);
+				inode->children.insert(0, level.data() + begin, get_offset(level.size(), parents.size(), i + 1) - begin);
+				recompute_info(d, inode);
+				parents[i] = inode;
+			}
+			level = std::move(parents);
+		}
+		nodes.insert(nodes.end(), level.begin(), level.end());
+	}
+	static void append_contents(const INode* node, std::vector<T>& contents) {
+		// append the contents of a node at COLD_DEPTH
+		if (node->cold) {
+			std::shared_ptr<const T> block;
+			const T* data = get_block(node, block);
+			contents.insert(contents.end(), data, data + node->cold->get_elements());
+			return;
+		}
+		for (const Node* child: node->children) {
+			for (const Node* leaf: static_cast<const INode*>(child)->children) {
+				const auto& children = static_cast<const Leaf*>(leaf)->children;
+				contents.insert(contents.end(), children.begin(), children.end());
+			}
+		}
+	}
+	static Node* copy_cold(A<Leaf, INode>& allocator, const INode* node) {
+		// the copy shares the contents, so that they are neither copied nor decompressed
+		INode* copy = new (allocator.template allocate<INode>()) INode();
+		copy->info = node->info;
+		for (std::size_t i = 0; i < node->children.get_size(); ++i) {
+			copy->children.insert(nullptr);
+			copy->infos[i] = node->infos[i];
+		}
+		copy->cold = node->cold;
+		return copy;
+	}
+	static void create_leaves(A<Leaf, INode>& allocator, const T* first, std::size_t n, std::size_t count, std::vector<Node*>& nodes) {
+		// pack n elements evenly into count leaves
+		for (std::size_t i = 0; i < count; ++i) {
+			Leaf* leaf = new (allocator.template allocate<Leaf>()) Leaf();
+			leaf->children.insert(0, first + get_offset(n, count, i), get_offset(n, count, i + 1) - get_offset(n, count, i));
+			recompute_info(0, leaf);
+			nodes.push_back(leaf);
+		}
+	}
+	static void create_leaves(A<Leaf, INode>& allocator, ChunkIterator chunk, std::size_t n, std::vector<Node*>& nodes) {
+		// pack n elements from chunk on into nearly full leaves
+		nodes.resize(std::max<std::size_t>(1, (n + Leaf::SIZE - 2) / (Leaf::SIZE - 1)));
+		std::size_t offset = 0;
+		for (std::size_t i = 0; i < nodes.size(); ++i) {
+			const std::size_t size = n / nodes.size() + (i < n % nodes.size());
+			Leaf* leaf = new (allocator.template allocate<Leaf>()) Leaf();
+			while (leaf->children.get_size() < size) {
+				const std::size_t count = std::min(size - leaf->children.get_size(), (*chunk).second - offset);
+				leaf->children.insert(leaf->children.get_size(), (*chunk).first + offset, count);
+				offset += count;
+				if (offset == (*chunk).second) {
+					++chunk;
+					offset = 0;
+				}
+			}
+			recompute_info(0, leaf);
+			nodes[i] = leaf;
+		}
+	}
+
+	A<Leaf, INode> allocator;
 	std::size_t depth;
 	Node* root;
+	// every modification gets a new version so that cursors can tell if their path is still valid
+	std::size_t version = get_next_version();
+	static std::size_t get_next_version() {
+		static std::atomic<std::size_t> next_version(1);
+		return next_version.fetch_add(1, std::memory_order_relaxed);
+	}
+	Tree(const A<Leaf, INode>& allocator): allocator(allocator), depth(0), root(create<Leaf>()) {}
+	Tree(const A<Leaf, INode>& allocator, std::size_t depth, Node* root): allocator(allocator), depth(depth), root(root) {
+		// take ownership of a node whose children are balanced but that can itself have less than 2 children
+		if (depth > 0 && static_cast<INode*>(root)->children.get_size() == 0) {
+			destroy(static_cast<INode*>(root));
+			this->depth = 0;
+			this->root = create<Leaf>();
+		}
+		shrink();
+	}
+	void grow(Node* new_child) {
+		if (new_child) {
+			++depth;
+			INode* new_root = create<INode>();
+			new_root->children.insert(root);
+			new_root->children.insert(new_child);
+			recompute_info(depth, new_root);
+			root = new_root;
+		}
+	}
+	void shrink() {
+		while (depth > 0 && static_cast<INode*>(root)->children.get_size() == 1) {
+			INode* node = unshare(depth, static_cast<INode*>(root));
+			root = unshare(depth - 1, node->children[0]);
+			destroy(node);
+			--depth;
+		}
+	}
+	bool is_empty() const {
+		return depth == 0 && static_cast<Leaf*>(root)->children.get_size() == 0;
+	}
 public:
-	Tree(): depth(0), root(new Leaf()) {}
+	Tree(): depth(0), root(create<Leaf>()) {}
+	Tree(const T* first, const T* last, std::size_t threads = 1): depth(0) {
+		// build the tree in O(n) from a contiguous range, the leaves are packed evenly and the inner levels are built bottom-up
+		const std::size_t n = last - first;
+		std::vector<Node*> nodes(std::max<std::size_t>(1, (n + Leaf::SIZE - 2) / (Leaf::SIZE - 1)));
+		// creating the leaves is most of the work, so it is split between the threads
+		threads = std::max<std::size_t>(1, std::min(threads, n / MIN_ELEMENTS_PER_THREAD));
+		if (threads > 1) {
+			// every thread allocates from its own pool, the pools are merged afterwards
+			std::vector<Tree> workers(threads - 1);
+			std::vector<std::thread> handles;
+			for (std::size_t i = 1; i < threads; ++i) {
+				handles.emplace_back([&, i]() {
+					workers[i - 1].create_leaves(first, n, nodes, nodes.size() * i / threads, nodes.size() * (i + 1) / threads);
+				});
+			}
+			create_leaves(first, n, nodes, 0, nodes.size() / threads);
+			for (std::size_t i = 0; i < handles.size(); ++i) {
+				handles[i].join();
+				allocator.merge(workers[i].allocator);
+			}
+		}
+		else {
+			create_leaves(first, n, nodes, 0, nodes.size());
+		}
+		root = create_inner_nodes(allocator, nodes, depth);
+	}
+	Tree(const T* first, const T* last, std::shared_ptr<const void> owner, std::size_t threads = 1): depth(0) {
+		// build the tree on top of a contiguous range that is kept alive by owner and must not change
+		// only the summaries are computed, lookups and iterators read the range directly and only a modification copies a part of it into leaves
+		static_assert(std::is_trivially_copyable<T>::value);
+		const std::size_t n = last - first;
+		const std::size_t leaves = std::max<std::size_t>(1, (n + Leaf::SIZE - 2) / (Leaf::SIZE - 1));
+		const std::size_t parents = (leaves + INode::SIZE - 2) / (INode::SIZE - 1);
+		if (parents < 2) {
+			// too small for nodes at COLD_DEPTH
+			std::vector<Node*> nodes(leaves);
+			create_leaves(first, n, nodes, 0, nodes.size());
+			root = create_inner_nodes(allocator, nodes, depth);
+			return;
+		}
+		std::vector<Node*> nodes((parents + INode::SIZE - 2) / (INode::SIZE - 1));
+		threads = std::max<std::size_t>(1, std::min(threads, n / MIN_ELEMENTS_PER_THREAD));
+		if (threads > 1) {
+			std::vector<Tree> workers(threads - 1);
+			std::vector<std::thread> handles;
+			for (std::size_t i = 1; i < threads; ++i) {
+				handles.emplace_back([&, i]() {
+					workers[i - 1].create_external_nodes(first, n, owner, parents, nodes, nodes.size() * i / threads, nodes.size() * (i + 1) / threads);
+				});
+			}
+			create_external_nodes(first, n, owner, parents, nodes, 0, nodes.size() / threads);
+			for (std::size_t i = 0; i < handles.size(); ++i) {
+				handles[i].join();
+				allocator.merge(workers[i].allocator);
+			}
+		}
+		else {
+			create_external_nodes(first, n, owner, parents, nodes, 0, nodes.size());
+		}
+		depth = COLD_DEPTH;
+		root = create_inner_nodes(allocator, nodes, depth);
+	}
+	Tree(const Tree& tree): allocator(tree.allocator), depth(tree.depth), root(tree.root), version(tree.version) {
+		// copying a tree is O(1), the nodes are shared until one of the trees is modified
+		retain(root);
+	}
+	Tree(Tree&& tree): allocator(tree.allocator), depth(tree.depth), root(tree.root), version(tree.version) {
+		tree.depth = 0;
+		tree.root = nullptr;
+		tree.version = get_next_version();
+	}
 	~Tree() {
-		free(depth, root);
+		// if no other tree can share our nodes the allocator releases them all at once
+		if (root && !(allocator.is_unique() && std::is_trivially_destructible<T>::value && std::is_trivially_destructible<I>::value)) {
+			release(depth, root);
+		}
+		else if (root && depth >= COLD_DEPTH) {
+			release_cold(depth, static_cast<INode*>(root));
+		}
+	}
+	Tree& operator =(const Tree& tree) {
+		retain(tree.root);
+		if (root) {
+			release(depth, root);
+		}
+		allocator = tree.allocator;
+		depth = tree.depth;
+		root = tree.root;
+		version = tree.version;
+		return *this;
+	}
+	Tree& operator =(Tree&& tree) {
+		std::swap(allocator, tree.allocator);
+		std::swap(depth, tree.depth);
+		std::swap(root, tree.root);
+		std::swap(version, tree.version);
+		return *this;
 	}
 	I get_info() const {
 		return root->info;
 	}
 	template <class C> Iterator get(C comp) const {
 		I sum;
-		return get(depth, root, sum, comp);
+		Iterator iterator;
+		iterator.depth = depth;
+		get(depth, root, sum, comp, iterator);
+		return iterator;
 	}
 	template <class C> I get_sum(C comp) const {
 		if (!(comp < get_info())) {
 			return get_info();
 		}
 		I sum;
-		get(depth, root, sum, comp);
+		Iterator iterator;
+		iterator.depth = depth;
+		get(depth, root, sum, comp, iterator);
 		return sum;
 	}
+	template <class C> static bool find_next(Iterator& iterator, I& sum, C comp) {
+		// move iterator to the first element at or after it at which comp < sum + the elements from iterator up to and including it
+		// the rest of the leaf is searched first, then the siblings to the right on the way up, so a nearby result is found quickly
+		// returns false if there is no such element, otherwise sum is the sum up to the element
+		if (iterator.path.get_size() < iterator.depth) {
+			if (find_next_in_block(static_cast<const INode*>(iterator.node), iterator.data, iterator.i, sum, comp)) {
+				return true;
+			}
+		}
+		else {
+			for (std::size_t i = iterator.i; i < iterator.size; ++i) {
+				const I next_sum = sum + get_info(iterator.data[i]);
+				if (comp < next_sum) {
+					iterator.i = i;
+					return true;
+				}
+				sum = next_sum;
+			}
+		}
+		const std::size_t depth = iterator.depth;
+		for (std::size_t level = iterator.path.get_size(); level > 0; --level) {
+			const INode* node = iterator.path[level - 1].first;
+			for (std::size_t i = iterator.path[level - 1].second + 1; i < node->children.get_size(); ++i) {
+				const I next_sum = sum + node->infos[i];
+				if (comp < next_sum) {
+					iterator.path[level - 1].second = i;
+					iterator.path.remove(level, iterator.path.get_size() - level);
+					get(depth - level, node->children[i], sum, comp, iterator);
+					return true;
+				}
+				sum = next_sum;
+			}
+		}
+		return false;
+	}
+	template <class C> static bool find_previous(Iterator& iterator, I& sum, C comp) {
+		// move iterator to the last element before it at which comp < the elements from there up to iterator + sum
+		// returns false if there is no such element, otherwise sum is the sum of the elements after it
+		if (iterator.path.get_size() < iterator.depth) {
+			if (find_previous_in_block(static_cast<const INode*>(iterator.node), iterator.data, iterator.i, sum, comp)) {
+				return true;
+			}
+		}
+		else {
+			for (std::size_t i = iterator.i; i > 0; --i) {
+				const I next_sum = get_info(iterator.data[i - 1]) + sum;
+				if (comp < next_sum) {
+					iterator.i = i - 1;
+					return true;
+				}
+				sum = next_sum;
+			}
+		}
+		const std::size_t depth = iterator.depth;
+		for (std::size_t level = iterator.path.get_size(); level > 0; --level) {
+			const INode* node = iterator.path[level - 1].first;
+			for (std::size_t i = iterator.path[level - 1].second; i > 0; --i) {
+				const I next_sum = node->infos[i - 1] + sum;
+				if (comp < next_sum) {
+					iterator.path[level - 1].second = i - 1;
+					iterator.path.remove(level, iterator.path.get_size() - level);
+					get_previous(depth - level, node->children[i - 1], sum, comp, iterator);
+					return true;
+				}
+				sum = next_sum;
+			}
+		}
+		return false;
+	}
 	template <class C> void insert(C comp, const T& t) {
-		Node* new_child = insert(depth, root, I(), comp, t);
-		if (new_child) {
+		version = get_next_version();
+		root = unshare(depth, root);
+		grow(insert(depth, root, I(), comp, t));
+	}
+	template <class C, class Iter> void insert(C comp, Iter first, Iter last) {
+		version = get_next_version();
+		std::vector<Node*> new_nodes;
+		root = unshare(depth, root);
+		insert(depth, root, I(), comp, first, std::distance(first, last), new_nodes);
+		while (!new_nodes.empty()) {
 			++depth;
-			INode* new_root = new INode();
+			INode* new_root = create<INode>();
 			new_root->children.insert(root);
-			new_root->children.insert(new_child);
-			recompute_info(depth, new_root);
 			root = new_root;
+			std::vector<Node*> new_children = std::move(new_nodes);
+			new_nodes.clear();
+			insert_children(depth, new_root, 1, new_children.data(), new_children.size(), new_nodes);
 		}
 	}
 	void append(const T& t) {
 		insert(tree_end(), t);
 	}
 	template <class Iter> void append(Iter first, Iter last) {
+		version = get_next_version();
 		while (first != last) {
-			Node* new_child = append(depth, root, first, last);
-			if (new_child) {
-				++depth;
-				INode* new_root = new INode();
+			root = unshare(depth, root);
+			grow(append(depth, root, first, last));
+		}
+	}
+	template <class C> void remove(C comp) {
+		version = get_next_version();
+		root = unshare(depth, root);
+		remove(depth, root, I(), comp);
+		shrink();
+	}
+	template <class C0, class C1> void remove(C0 begin, C1 end) {
+		version = get_next_version();
+		root = unshare(depth, root);
+		if (remove(depth, root, I(), begin, end)) {
+			release(depth, root);
+			depth = 0;
+			root = create<Leaf>();
+			return;
+		}
+		// merging children can make their parents underflow again, so repeat until nothing changes
+		do {
+			shrink();
+		} while (depth > 0 && repair(depth, static_cast<INode*>(root), I(), begin));
+	}
+	template <class C> Tree split(C comp) {
+		// remove everything starting at comp from this tree and return it as a new tree in O(log n)
+		Tree left(allocator);
+		Tree right(allocator);
+		version = get_next_version();
+		root = unshare(depth, root);
+		split(depth, root, I(), comp, left, right);
+		root = nullptr;
+		*this = std::move(left);
+		return right;
+	}
+	void concat(Tree&& tree) {
+		// append all elements of tree to this tree in O(log n)
+		if (tree.is_empty()) {
+			return;
+		}
+		allocator.merge(tree.allocator);
+		version = get_next_version();
+		tree.version = get_next_version();
+		if (is_empty()) {
+			*this = std::move(tree);
+			return;
+		}
+		if (depth < tree.depth) {
+			tree.root = unshare(tree.depth, tree.root);
+			Node* new_child = join_left(tree.depth, static_cast<INode*>(tree.root), depth, root);
+			depth = tree.depth;
+			root = tree.root;
+			tree.root = nullptr;
+			grow(new_child);
+		}
+		else {
+			if (depth == tree.depth) {
+				INode* new_root = create<INode>();
 				new_root->children.insert(root);
-				new_root->children.insert(new_child);
-				recompute_info(depth, new_root);
 				root = new_root;
+				++depth;
 			}
+			else {
+				root = unshare(depth, root);
+			}
+			Node* new_child = join_right(depth, static_cast<INode*>(root), tree.depth, tree.root);
+			tree.root = nullptr;
+			grow(new_child);
+			shrink();
 		}
 	}
-	template <class C> void remove(C comp) {
-		remove(depth, root, I(), comp);
-		if (depth > 0) {
-			INode* node = static_cast<INode*>(root);
-			if (node->children.get_size() == 1) {
-				root = node->children[0];
-				delete node;
-				--depth;
+	void compact() {
+		// rebuild the tree from nearly full leaves, allocated next to each other from a new pool
+		// cold nodes are kept as they are, only the parts between them are packed again
+		A<Leaf, INode> pool;
+		std::vector<const INode*> subtrees;
+		if (depth >= COLD_DEPTH) {
+			get_subtrees(depth, root, subtrees);
+		}
+		std::vector<Node*> nodes;
+		if (std::none_of(subtrees.begin(), subtrees.end(), [](const INode* node) { return node->cold != nullptr; })) {
+			std::size_t n = 0;
+			for (ChunkIterator i = chunks_begin(); i != chunks_end(); ++i) {
+				n += (*i).second;
+			}
+			create_leaves(pool, chunks_begin(), n, nodes);
+			std::size_t new_depth = 0;
+			Node* new_root = create_inner_nodes(pool, nodes, new_depth);
+			*this = Tree(pool, new_depth, new_root);
+			return;
+		}
+		std::vector<T> run;
+		std::size_t sizes[COLD_DEPTH + 1];
+		for (std::size_t i = 0; i < subtrees.size(); ++i) {
+			if (!subtrees[i]->cold) {
+				append_contents(subtrees[i], run);
+				continue;
+			}
+			if (run.empty()) {
+				nodes.push_back(copy_cold(pool, subtrees[i]));
+				continue;
 			}
+			if (!get_subtree_sizes(run.size(), sizes)) {
+				// a short run takes the following cold node along
+				append_contents(subtrees[i], run);
+				continue;
+			}
+			create_subtrees(pool, run.data(), run.size(), nodes);
+			run.clear();
+			nodes.push_back(copy_cold(pool, subtrees[i]));
+		}
+		std::size_t new_depth = COLD_DEPTH;
+		if (!run.empty() && !get_subtree_sizes(run.size(), sizes) && !nodes.empty()) {
+			// a short run at the end takes the preceding cold node along
+			INode* last = static_cast<INode*>(nodes.back());
+			std::vector<T> contents;
+			append_contents(last, contents);
+			run.insert(run.begin(), contents.begin(), contents.end());
+			last->~INode();
+			pool.deallocate(last);
+			nodes.pop_back();
 		}
+		if (!run.empty() && nodes.empty()) {
+			// everything is in one run, so the subtrees don't have to line up
+			create_leaves(pool, run.data(), run.size(), std::max<std::size_t>(1, (run.size() + Leaf::SIZE - 2) / (Leaf::SIZE - 1)), nodes);
+			new_depth = 0;
+		}
+		else if (!run.empty()) {
+			create_subtrees(pool, run.data(), run.size(), nodes);
+		}
+		Node* new_root = create_inner_nodes(pool, nodes, new_depth);
+		*this = Tree(pool, new_depth, new_root);
+	}
+	void compress(std::size_t keep = 0) {
+		// compress the contents of the nodes at COLD_DEPTH, except for the keep most recently modified ones
+		// their summaries stay in place, lookups and iterators decompress the contents they reach and only a modification creates leaves again
+		static_assert(std::is_trivially_copyable<T>::value);
+		if (depth <= COLD_DEPTH) {
+			return;
+		}
+		std::vector<std::size_t> used;
+		get_used(depth, static_cast<INode*>(root), used);
+		std::size_t min_used = SIZE_MAX;
+		if (keep >= used.size()) {
+			min_used = used.empty() ? SIZE_MAX : *std::min_element(used.begin(), used.end());
+		}
+		else if (keep > 0) {
+			std::nth_element(used.begin(), used.end() - keep, used.end());
+			min_used = *(used.end() - keep);
+		}
+		version = get_next_version();
+		root = unshare(depth, root);
+		compress(depth, static_cast<INode*>(root), min_used);
+	}
+	std::size_t get_version() const {
+		// changes with every modification
+		return version;
+	}
+	Stats get_stats() const {
+		Stats stats;
+		get_stats(depth, root, stats);
+		return stats;
+	}
+	bool check() const {
+		// verify that no node is full or underfull and that all summaries and their copies are up to date, requires I to be comparable
+		return check(depth, root, true);
 	}
 	Iterator begin() const {
 		return get(tree_begin());
@@ -501,4 +2246,10 @@ public:
 	Iterator end() const {
 		return get(tree_end());
 	}
+	ChunkIterator chunks_begin() const {
+		return ChunkIterator(begin());
+	}
+	ChunkIterator chunks_end() const {
+		return ChunkIterator(end());
+	}
 };
@@ -0,0 +1,237 @@
+// micro-benchmarks for Tree, reports the time per operation and the memory per element for several node sizes
+// g++ -std=c++17 -O2 -march=native tree_bench.cpp -o tree_bench && ./tree_bench [max size, e.g. 1G]
+
+#include "editor.hpp"
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+template <std::size_t L, std::size_t N> struct SumInfo {
+	// the count and the sum of 32 bit integers, the node sizes are parameters so that they can be compared
+	using T = std::uint32_t;
+	static constexpr std::size_t LEAF_SIZE = L;
+	static constexpr std::size_t INODE_SIZE = N;
+	std::size_t count;
+	std::uint64_t sum;
+	constexpr SumInfo(std::size_t count, std::uint64_t sum): count(count), sum(sum) {}
+	constexpr SumInfo(): count(0), sum(0) {}
+	constexpr SumInfo(T t): count(1), sum(t) {}
+	constexpr SumInfo operator +(const SumInfo& info) const {
+		return SumInfo(count + info.count, sum + info.sum);
+	}
+	constexpr SumInfo operator -(const SumInfo& info) const {
+		return SumInfo(count - info.count, sum - info.sum);
+	}
+	constexpr bool operator ==(const SumInfo& info) const {
+		return count == info.count && sum == info.sum;
+	}
+};
+class CountComp {
+	std::size_t count;
+public:
+	constexpr CountComp(std::size_t count): count(count) {}
+	template <class I> constexpr bool operator <(const I& info) const {
+		return count < info.count;
+	}
+};
+class SumComp {
+	std::uint64_t sum;
+public:
+	constexpr SumComp(std::uint64_t sum): sum(sum) {}
+	template <class I> constexpr bool operator <(const I& info) const {
+		return sum < info.sum;
+	}
+};
+// the number of random operations per measurement, the tree at most doubles in size while they are inserted
+static constexpr std::size_t OPERATIONS = 1 << 16;
+static constexpr std::size_t MIN_SIZE = 1024;
+// the sizes grow by this factor, from 1 KB up to the size given on the command line or 1 MB
+static constexpr std::size_t SIZE_FACTOR = 32;
+
+static std::mt19937_64 rng;
+// results are added here so that the compiler can't remove the work
+static volatile std::size_t sink;
+
+static std::string format_size(std::size_t size) {
+	const char* units[] = {"B", "K", "M", "G"};
+	std::size_t unit = 0;
+	while (unit + 1 < 4 && size >= 1024 && size % 1024 == 0) {
+		size /= 1024;
+		++unit;
+	}
+	return std::to_string(size) + units[unit];
+}
+static std::size_t parse_size(const char* string) {
+	char* end;
+	std::size_t size = std::strtoull(string, &end, 10);
+	switch (*end) {
+	case 'G':
+	case 'g':
+		size *= 1024;
+		// fall through
+	case 'M':
+	case 'm':
+		size *= 1024;
+		// fall through
+	case 'K':
+	case 'k':
+		size *= 1024;
+	}
+	return size;
+}
+template <class F> static double measure(std::size_t n, F f) {
+	// the average time of f(0) to f(n - 1) in nanoseconds
+	const auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < n; ++i) {
+		f(i);
+	}
+	const auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count() / std::max<std::size_t>(n, 1);
+}
+static void report(const std::string& tree, std::size_t size, const std::string& operation, double ns) {
+	std::printf("%-14s %6s  %-28s %10.1f ns/op\n", tree.c_str(), format_size(size).c_str(), operation.c_str(), ns);
+}
+template <class I> static void report_memory(const std::string& tree, std::size_t size, const std::string& state, const Tree<I>& t) {
+	const typename Tree<I>::Stats stats = t.get_stats();
+	std::printf("%-14s %6s  %-28s %10.2f bytes/element\n", tree.c_str(), format_size(size).c_str(), ("memory " + state).c_str(), static_cast<double>(stats.bytes) / std::max<std::size_t>(stats.elements, 1));
+}
+static std::vector<std::size_t> get_random_positions(std::size_t n, std::size_t size, std::ptrdiff_t growth) {
+	// n random positions in a tree that starts with size elements and grows by growth with every operation
+	std::vector<std::size_t> positions(n);
+	for (std::size_t i = 0; i < n; ++i) {
+		positions[i] = rng() % (size + growth * static_cast<std::ptrdiff_t>(i) + (growth > 0));
+	}
+	return positions;
+}
+
+static std::size_t get_position(const TextBuffer::Info& info) {
+	return info.bytes;
+}
+template <std::size_t L, std::size_t N> static std::size_t get_position(const SumInfo<L, N>& info) {
+	return info.count;
+}
+
+template <class I, class F> static void run_lookups(const std::string& name, std::size_t size, const Tree<I>& tree, const std::string& comp, std::size_t total, F get_comp) {
+	// random lookups by one comp, get returns an iterator and get_sum only the sum before it
+	const std::vector<std::size_t> positions = get_random_positions(OPERATIONS, total, 0);
+	report(name, size, "get by " + comp, measure(OPERATIONS, [&](std::size_t i) {
+		sink += *tree.get(get_comp(positions[i]));
+	}));
+	report(name, size, "get_sum by " + comp, measure(OPERATIONS, [&](std::size_t i) {
+		sink += get_position(tree.get_sum(get_comp(positions[i])));
+	}));
+}
+template <class I, class F> static Tree<I> run(const std::string& name, std::size_t size, const std::vector<typename I::T>& elements, F get_comp) {
+	// the operations that every tree supports, get_comp creates the comp that finds the element at an index
+	using T = typename I::T;
+	const std::size_t n = elements.size();
+	Tree<I> tree;
+	report(name, size, "build from range", measure(1, [&](std::size_t) {
+		tree = Tree<I>(elements.data(), elements.data() + n);
+	}) / n);
+	report_memory(name, size, "after build", tree);
+	tree = Tree<I>();
+	report(name, size, "append", measure(n, [&](std::size_t i) {
+		tree.append(elements[i]);
+	}));
+	report_memory(name, size, "after append", tree);
+	report(name, size, "iterate", measure(1, [&](std::size_t) {
+		std::size_t sum = 0;
+		for (const T& element: tree) {
+			sum += element;
+		}
+		sink += sum;
+	}) / n);
+	report(name, size, "iterate chunks", measure(1, [&](std::size_t) {
+		std::size_t sum = 0;
+		const auto end = tree.chunks_end();
+		for (auto chunk = tree.chunks_begin(); chunk != end; ++chunk) {
+			const std::pair<const T*, std::size_t> data = *chunk;
+			for (std::size_t i = 0; i < data.second; ++i) {
+				sum += data.first[i];
+			}
+		}
+		sink += sum;
+	}) / n);
+	run_lookups(name, size, tree, "index", n, get_comp);
+	const std::size_t operations = std::min(n, OPERATIONS);
+	std::vector<std::size_t> positions = get_random_positions(operations, n, 1);
+	report(name, size, "insert random", measure(operations, [&](std::size_t i) {
+		tree.insert(get_comp(positions[i]), elements[i]);
+	}));
+	positions = get_random_positions(operations, n + operations, -1);
+	report(name, size, "remove random", measure(operations, [&](std::size_t i) {
+		tree.remove(get_comp(positions[i]));
+	}));
+	report(name, size, "insert sequential", measure(operations, [&](std::size_t i) {
+		tree.insert(get_comp(n / 2 + i), elements[i]);
+	}));
+	report(name, size, "remove sequential", measure(operations, [&](std::size_t) {
+		tree.remove(get_comp(n / 2));
+	}));
+	report_memory(name, size, "after edits", tree);
+	return tree;
+}
+template <std::size_t L, std::size_t N> static void run_sums(std::size_t size) {
+	using I = SumInfo<L, N>;
+	const std::string name = "sums " + std::to_string(L) + "/" + std::to_string(N);
+	std::vector<std::uint32_t> elements(size / sizeof(std::uint32_t));
+	for (std::uint32_t& element: elements) {
+		element = rng() % 1000;
+	}
+	const Tree<I> tree = run<I>(name, size, elements, [](std::size_t count) {
+		return CountComp(count);
+	});
+	run_lookups(name, size, tree, "sum", tree.get_info().sum, [](std::size_t sum) {
+		return SumComp(sum);
+	});
+}
+static void run_text(std::size_t size) {
+	const std::string name = "text " + std::to_string(TextBuffer::Info::LEAF_SIZE) + "/" + std::to_string(TextBuffer::Info::INODE_SIZE);
+	// lines of up to 120 codepoints, mostly ascii
+	std::vector<char> elements;
+	elements.reserve(size);
+	while (elements.size() < size) {
+		for (std::size_t i = rng() % 120; i > 0 && elements.size() + 3 < size; --i) {
+			const std::size_t c = rng() % 64;
+			if (c == 0) {
+				elements.insert(elements.end(), {'\xe2', '\x82', '\xac'});
+			}
+			else if (c == 1) {
+				elements.insert(elements.end(), {'\xc3', '\xa4'});
+			}
+			else {
+				elements.push_back("abcdefghijklmnopqrstuvwxyz (){}.;"[c % 33]);
+			}
+		}
+		elements.push_back('\n');
+	}
+	const Tree<TextBuffer::Info> tree = run<TextBuffer::Info>(name, size, elements, [](std::size_t bytes) {
+		return TextBuffer::ByteComp(bytes);
+	});
+	run_lookups(name, size, tree, "codepoints", tree.get_info().codepoints, [](std::size_t codepoints) {
+		return TextBuffer::CodepointComp(codepoints);
+	});
+	run_lookups(name, size, tree, "line", tree.get_info().newlines, [](std::size_t newlines) {
+		return TextBuffer::LineComp(newlines);
+	});
+}
+
+int main(int argc, char** argv) {
+	const std::size_t max_size = argc > 1 ? parse_size(argv[1]) : 1024 * 1024;
+	for (std::size_t size = MIN_SIZE; size <= max_size; size *= SIZE_FACTOR) {
+		run_text(size);
+		// the node sizes to compare, the leaves hold one element less than LEAF_SIZE
+		run_sums<16, 8>(size);
+		run_sums<32, 8>(size);
+		run_sums<80, 12>(size);
+		run_sums<128, 12>(size);
+		run_sums<264, 12>(size);
+		run_sums<264, 24>(size);
+		run_sums<512, 16>(size);
+		run_sums<1024, 32>(size);
+	}
+}
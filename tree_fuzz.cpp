@@ -0,0 +1,651 @@
+// differential fuzzer for Tree and TextBuffer, every operation is also applied to a std::vector or a std::string and the results are compared
+// g++ -std=c++17 -O1 -g -fsanitize=address,undefined tree_fuzz.cpp -o tree_fuzz && ./tree_fuzz [seed] [iterations]
+
+#include "editor.hpp"
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+using Info = TextBuffer::Info;
+using ByteComp = TextBuffer::ByteComp;
+using LineComp = TextBuffer::LineComp;
+
+struct SumInfo {
+	// the count and the sum of 32 bit integers, which form a commutative group, so that Tree takes the delta path for single insertions and removals
+	using T = std::uint32_t;
+	// small nodes, so that a few thousand elements already have several levels and cold nodes
+	static constexpr std::size_t LEAF_SIZE = 16;
+	static constexpr std::size_t INODE_SIZE = 8;
+	std::size_t count;
+	std::uint64_t sum;
+	constexpr SumInfo(std::size_t count, std::uint64_t sum): count(count), sum(sum) {}
+	constexpr SumInfo(): count(0), sum(0) {}
+	constexpr SumInfo(T t): count(1), sum(t) {}
+	constexpr SumInfo operator +(const SumInfo& info) const {
+		return SumInfo(count + info.count, sum + info.sum);
+	}
+	constexpr SumInfo operator -(const SumInfo& info) const {
+		return SumInfo(count - info.count, sum - info.sum);
+	}
+	constexpr bool operator ==(const SumInfo& info) const {
+		return count == info.count && sum == info.sum;
+	}
+};
+static_assert(HasInverse<SumInfo>::value);
+class CountComp {
+	std::size_t count;
+public:
+	constexpr CountComp(std::size_t count): count(count) {}
+	constexpr bool operator <(const SumInfo& info) const {
+		return count < info.count;
+	}
+};
+
+// every so many iterations the whole contents are compared in both directions
+static constexpr std::size_t CONTENTS_INTERVAL = 64;
+
+static std::mt19937_64 rng;
+static std::size_t iteration;
+static const char* operation;
+
+static std::size_t get_random(std::size_t n) {
+	// a random number in [0, n]
+	return rng() % (n + 1);
+}
+static std::size_t get_random_length() {
+	// mostly short edits with the occasional long one that spans several leaves or whole inner nodes
+	switch (rng() % 8) {
+	case 0:
+		return get_random(20000);
+	case 1:
+	case 2:
+		return get_random(1000);
+	default:
+		return get_random(20);
+	}
+}
+static void add_random_element(std::vector<char>& text) {
+	// ascii, brackets and newlines with the occasional valid or invalid multibyte sequence, so that every field of the summaries changes
+	static const char* const alphabet = "ab\ncd()[]{}\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80\xe0\xed\xa0\xf4\x90\xc0\xbf";
+	const std::size_t common = 11;
+	const std::size_t all = std::strlen(alphabet);
+	text.push_back(alphabet[rng() % (rng() % 16 == 0 ? all : common)]);
+}
+static void add_random_element(std::vector<std::uint32_t>& elements) {
+	// large values, so that the sums wrap around
+	elements.push_back(rng() % 4 == 0 ? static_cast<std::uint32_t>(rng()) : rng() % 1000);
+}
+template <class T> static std::vector<T> get_random_elements(std::size_t size) {
+	std::vector<T> elements;
+	elements.reserve(size);
+	for (std::size_t i = 0; i < size; ++i) {
+		add_random_element(elements);
+	}
+	return elements;
+}
+static void fail(const char* message) {
+	std::fprintf(stderr, "iteration %zu, %s: %s\n", iteration, operation, message);
+	std::abort();
+}
+static void expect(bool condition, const char* message) {
+	if (!condition) {
+		fail(message);
+	}
+}
+
+template <class I> static I get_fold(const typename I::T* data, std::size_t size) {
+	// the summary of the elements added one by one, which doesn't share any code with the leaf kernels
+	I info;
+	for (std::size_t i = 0; i < size; ++i) {
+		info = info + I(data[i]);
+	}
+	return info;
+}
+static std::size_t get_position(const Info& info) {
+	return info.bytes;
+}
+static std::size_t get_position(const SumInfo& info) {
+	return info.count;
+}
+
+template <class I> static std::vector<typename I::T> get_contents(const Tree<I>& tree) {
+	std::vector<typename I::T> contents;
+	const auto end = tree.chunks_end();
+	for (auto chunk = tree.chunks_begin(); chunk != end; ++chunk) {
+		contents.insert(contents.end(), (*chunk).first, (*chunk).first + (*chunk).second);
+	}
+	return contents;
+}
+template <class I> static std::vector<typename I::T> get_contents_backward(const Tree<I>& tree) {
+	// iterating backward goes through the leaves in the opposite order, which exercises the path instead of sibling links
+	std::vector<typename I::T> contents;
+	typename Tree<I>::Iterator iterator = tree.end();
+	const typename Tree<I>::Iterator begin = tree.begin();
+	while (iterator != begin) {
+		--iterator;
+		contents.push_back(*iterator);
+	}
+	return std::vector<typename I::T>(contents.rbegin(), contents.rend());
+}
+static void check_lines(const Tree<Info>& tree, const std::vector<char>& model) {
+	// the start of a line, which is found by the newlines
+	const std::size_t line = get_random(tree.get_info().newlines);
+	auto end = model.begin();
+	for (std::size_t i = 0; i < line; ++i) {
+		end = std::find(end, model.end(), '\n') + 1;
+	}
+	end = std::find(end, model.end(), '\n');
+	expect(tree.get_sum(LineComp(line)).bytes == static_cast<std::size_t>(end - model.begin()), "get_sum by line");
+	// the next and previous newline from a random position
+	const std::size_t index = get_random(model.size());
+	Tree<Info>::Iterator iterator = tree.get(ByteComp(index));
+	Info sum;
+	const auto next = std::find(model.begin() + index, model.end(), '\n');
+	const bool found_next = Tree<Info>::find_next(iterator, sum, LineComp(0));
+	expect(found_next == (next != model.end()), "find_next");
+	expect(!found_next || (*iterator == '\n' && sum.bytes == static_cast<std::size_t>(next - model.begin()) - index), "find_next");
+	iterator = tree.get(ByteComp(index));
+	sum = Info();
+	const auto previous = std::find(std::make_reverse_iterator(model.begin() + index), model.rend(), '\n');
+	const bool found_previous = Tree<Info>::find_previous(iterator, sum, LineComp(0));
+	expect(found_previous == (previous != model.rend()), "find_previous");
+	// the newline that was found is the last one that isn't after index
+	expect(!found_previous || (*iterator == '\n' && sum.bytes == static_cast<std::size_t>(previous - std::make_reverse_iterator(model.begin() + index))), "find_previous");
+}
+static void check_lines(const Tree<SumInfo>& tree, const std::vector<std::uint32_t>& model) {}
+template <class I, class C> static void check_lookups(const Tree<I>& tree, const std::vector<typename I::T>& model) {
+	for (std::size_t k = 0; k < 4; ++k) {
+		const std::size_t index = get_random(model.size());
+		const typename Tree<I>::Iterator iterator = tree.get(C(index));
+		expect(index == model.size() ? iterator == tree.end() : *iterator == model[index], "get");
+		expect(tree.get_sum(C(index)) == get_fold<I>(model.data(), index), "get_sum");
+	}
+	// the element a random distance after a random position
+	const std::size_t index = get_random(model.size());
+	const std::size_t distance = get_random_length();
+	typename Tree<I>::Iterator iterator = tree.get(C(index));
+	I sum;
+	const bool found = Tree<I>::find_next(iterator, sum, C(distance));
+	expect(found == (index + distance < model.size()), "find_next");
+	expect(!found || (*iterator == model[index + distance] && get_position(sum) == distance), "find_next");
+	check_lines(tree, model);
+}
+template <class I, class C> static void check(const Tree<I>& tree, const std::vector<typename I::T>& model, bool contents) {
+	expect(tree.check(), "check");
+	expect(tree.get_info() == get_fold<I>(model.data(), model.size()), "get_info");
+	expect(tree.get_stats().elements == model.size(), "get_stats");
+	if (contents) {
+		expect(get_contents(tree) == model, "contents");
+		expect(get_contents_backward(tree) == model, "contents backward");
+	}
+	check_lookups<I, C>(tree, model);
+}
+
+template <class I> static Tree<I> create_tree(const std::vector<typename I::T>& elements) {
+	// either a tree that owns its elements or one that refers to an external buffer, built with one or more threads
+	if (rng() % 2) {
+		const auto owner = std::make_shared<const std::vector<typename I::T>>(elements);
+		return Tree<I>(owner->data(), owner->data() + owner->size(), owner, 1 + rng() % 2);
+	}
+	return Tree<I>(elements.data(), elements.data() + elements.size(), 1 + rng() % 2);
+}
+template <class I, class C> static void apply(Tree<I>& tree, std::vector<typename I::T>& model) {
+	using T = typename I::T;
+	switch (rng() % 12) {
+	case 0: {
+		operation = "insert";
+		const std::size_t index = get_random(model.size());
+		const T t = get_random_elements<T>(1)[0];
+		tree.insert(C(index), t);
+		model.insert(model.begin() + index, t);
+		break;
+	}
+	case 1:
+	case 2: {
+		operation = "insert range";
+		const std::size_t index = get_random(model.size());
+		const std::vector<T> elements = get_random_elements<T>(get_random_length());
+		tree.insert(C(index), elements.begin(), elements.end());
+		model.insert(model.begin() + index, elements.begin(), elements.end());
+		break;
+	}
+	case 3: {
+		operation = "remove";
+		if (model.empty()) {
+			break;
+		}
+		const std::size_t index = rng() % model.size();
+		tree.remove(C(index));
+		model.erase(model.begin() + index);
+		break;
+	}
+	case 4:
+	case 5: {
+		operation = "remove range";
+		const std::size_t index0 = get_random(model.size());
+		const std::size_t index1 = rng() % 16 == 0 ? get_random(model.size() - index0) + index0 : std::min(model.size(), index0 + get_random_length());
+		tree.remove(C(index0), C(index1));
+		model.erase(model.begin() + index0, model.begin() + index1);
+		break;
+	}
+	case 6: {
+		operation = "append";
+		const std::vector<T> elements = get_random_elements<T>(get_random_length());
+		tree.append(elements.begin(), elements.end());
+		model.insert(model.end(), elements.begin(), elements.end());
+		break;
+	}
+	case 7: {
+		// split and concat again, sometimes in the other order so that trees of very different heights are joined
+		operation = "split and concat";
+		const std::size_t index = get_random(model.size());
+		Tree<I> right = tree.split(C(index));
+		expect(tree.check() && right.check(), "split");
+		expect(tree.get_info() == get_fold<I>(model.data(), index), "split");
+		if (rng() % 2) {
+			tree.concat(std::move(right));
+		}
+		else {
+			right.concat(std::move(tree));
+			tree = std::move(right);
+			std::rotate(model.begin(), model.begin() + index, model.end());
+		}
+		break;
+	}
+	case 8: {
+		operation = "insert tree";
+		const std::size_t index = get_random(model.size());
+		const std::vector<T> elements = get_random_elements<T>(rng() % 4 == 0 ? get_random(100000) : get_random_length());
+		Tree<I> right = tree.split(C(index));
+		tree.concat(create_tree<I>(elements));
+		tree.concat(std::move(right));
+		model.insert(model.begin() + index, elements.begin(), elements.end());
+		break;
+	}
+	case 9: {
+		operation = "compress";
+		tree.compress(get_random(3));
+		break;
+	}
+	case 10: {
+		operation = "compact";
+		tree.compact();
+		break;
+	}
+	case 11: {
+		// edits of a copy must not be visible in the original, which shares its nodes
+		operation = "copy";
+		Tree<I> copy = tree;
+		std::vector<T> copy_model = model;
+		for (std::size_t i = 0; i < 4; ++i) {
+			apply<I, C>(copy, copy_model);
+		}
+		operation = "copy";
+		check<I, C>(copy, copy_model, false);
+		break;
+	}
+	}
+}
+
+template <class I, class C> static void run(const char* name, std::size_t max_size, std::size_t seed, std::size_t iterations) {
+	// the contents stay large enough for several levels of nodes and cold nodes, but small enough to be compared after every operation
+	rng.seed(seed);
+	operation = "create";
+	std::vector<typename I::T> model = get_random_elements<typename I::T>(get_random(max_size / 2));
+	Tree<I> tree = create_tree<I>(model);
+	check<I, C>(tree, model, true);
+	for (iteration = 0; iteration < iterations; ++iteration) {
+		apply<I, C>(tree, model);
+		if (model.size() > max_size) {
+			operation = "shrink";
+			const std::size_t index = get_random(model.size() - max_size / 2);
+			tree.remove(C(index), C(index + max_size / 2));
+			model.erase(model.begin() + index, model.begin() + index + max_size / 2);
+		}
+		check<I, C>(tree, model, iteration % CONTENTS_INTERVAL == 0);
+	}
+	check<I, C>(tree, model, true);
+	std::printf("%s, seed %zu: %zu iterations passed\n", name, seed, iterations);
+}
+
+// the TextBuffer pass compares its queries with scans of a std::string
+
+static std::string get_random_string(std::size_t size) {
+	// some letters in uppercase, so that searches that ignore case find more than the others
+	std::string text;
+	for (char c: get_random_elements<char>(size)) {
+		text.push_back(c >= 'a' && c <= 'z' && rng() % 4 == 0 ? static_cast<char>(c - 'a' + 'A') : c);
+	}
+	return text;
+}
+static std::size_t get_valid_prefix(const std::string& text, std::size_t i, std::size_t& length) {
+	// the number of bytes at i that start some valid sequence and the length of that sequence, which is found by the range of codepoints the sequence can still encode
+	const unsigned char c = text[i];
+	length = c < 0x80 ? 1 : c < 0xC0 ? 0 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : 0;
+	if (length <= 1) {
+		return length;
+	}
+	const std::uint32_t min = length == 2 ? 0x80 : length == 3 ? 0x800 : 0x10000;
+	std::uint32_t codepoint = c & (0x7F >> length);
+	std::size_t n = 0;
+	while (n < length) {
+		const std::size_t rest = 6 * (length - n - 1);
+		const std::uint32_t low = codepoint << rest;
+		const std::uint32_t high = low | ((1u << rest) - 1);
+		if (high < min || low > 0x10FFFF || (low >= 0xD800 && high <= 0xDFFF)) {
+			break;
+		}
+		++n;
+		if (n == length || i + n == text.size() || (text[i + n] & 0xC0) != 0x80) {
+			break;
+		}
+		codepoint = codepoint << 6 | (text[i + n] & 0x3F);
+	}
+	return n;
+}
+static std::string get_repaired(const std::string& text) {
+	// every maximal prefix of a valid sequence that is not complete is replaced with U+FFFD, bytes that start no valid sequence each on their own
+	std::string repaired;
+	for (std::size_t i = 0; i < text.size();) {
+		std::size_t length;
+		const std::size_t n = get_valid_prefix(text, i, length);
+		if (length > 0 && n == length) {
+			repaired.append(text, i, n);
+		}
+		else {
+			repaired.append("\xEF\xBF\xBD");
+		}
+		i += std::max<std::size_t>(n, 1);
+	}
+	return repaired;
+}
+static std::size_t get_utf16_position(const std::string& text, std::size_t line, std::size_t utf16_column) {
+	// like get_info_for_line_utf16, every byte that isn't a continuation byte starts a codepoint and the ones from 0xF0 take two code units
+	std::size_t i = 0;
+	for (std::size_t l = 0; l < line; ++l) {
+		i = text.find('\n', i);
+		if (i == std::string::npos) {
+			return text.size();
+		}
+		++i;
+	}
+	for (std::size_t units = 0; i < text.size() && text[i] != '\n'; ++i) {
+		const unsigned char c = text[i];
+		const std::size_t width = (c & 0xC0) == 0x80 ? 0 : c >= 0xF0 ? 2 : 1;
+		if (width > 0 && units + width > utf16_column) {
+			break;
+		}
+		units += width;
+	}
+	return i;
+}
+static bool find_bracket(const std::string& text, std::size_t index, std::size_t kind, bool forward, std::size_t& result) {
+	// the first bracket from index in the given direction that makes the depth negative
+	static const char brackets[] = "()[]{}";
+	std::ptrdiff_t depth = 0;
+	for (std::size_t i = forward ? index : index - 1; forward ? i < text.size() : i != SIZE_MAX; forward ? ++i : --i) {
+		depth += (text[i] == brackets[2 * kind + !forward]) - (text[i] == brackets[2 * kind + forward]);
+		if (depth < 0) {
+			result = i;
+			return true;
+		}
+	}
+	return false;
+}
+static bool find_matching_bracket(const std::string& text, std::size_t index, std::size_t& result) {
+	static const char brackets[] = "()[]{}";
+	const char* bracket = index < text.size() && text[index] != '\0' ? std::strchr(brackets, text[index]) : nullptr;
+	if (!bracket) {
+		return false;
+	}
+	const std::size_t kind = (bracket - brackets) / 2;
+	return (bracket - brackets) % 2 == 0 ? find_bracket(text, index + 1, kind, true, result) : find_bracket(text, index, kind, false, result);
+}
+static bool matches(const std::string& text, std::size_t index, const std::string& needle, bool ignore_case) {
+	for (std::size_t j = 0; j < needle.size(); ++j) {
+		const char a = text[index + j];
+		const char b = needle[j];
+		if (ignore_case ? std::tolower(static_cast<unsigned char>(a)) != std::tolower(static_cast<unsigned char>(b)) || (a & 0x80) != (b & 0x80) : a != b) {
+			return false;
+		}
+	}
+	return true;
+}
+static std::string read_file(const char* path) {
+	std::ifstream file(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void check_search(const TextBuffer& buffer, const std::string& model) {
+	// a needle that occurs in the text or one that was made up, in a different case if case is ignored
+	const bool ignore_case = rng() % 2;
+	const std::size_t size = 1 + get_random(rng() % 4 == 0 ? 40 : 4);
+	std::string needle = rng() % 2 && model.size() >= size ? model.substr(get_random(model.size() - size), size) : get_random_string(size);
+	if (ignore_case) {
+		for (char& c: needle) {
+			c = rng() % 2 ? std::toupper(static_cast<unsigned char>(c)) : std::tolower(static_cast<unsigned char>(c));
+		}
+	}
+	const std::size_t index = get_random(model.size());
+	std::size_t next = index;
+	while (next + size <= model.size() && !matches(model, next, needle, ignore_case)) {
+		++next;
+	}
+	std::size_t result;
+	const bool found_next = buffer.find_next(index, needle.data(), size, ignore_case, result);
+	expect(found_next == (next + size <= model.size()) && (!found_next || result == next), "find_next");
+	std::size_t previous = std::min(index, model.size() + 1 - std::min(size, model.size() + 1));
+	while (previous > 0 && !matches(model, previous - 1, needle, ignore_case)) {
+		--previous;
+	}
+	const bool found_previous = buffer.find_previous(index, needle.data(), size, ignore_case, result);
+	expect(found_previous == (previous > 0) && (!found_previous || result == previous - 1), "find_previous");
+	if (rng() % 8 == 0) {
+		std::vector<std::size_t> all;
+		for (std::size_t i = 0; i + size <= model.size(); ++i) {
+			if (matches(model, i, needle, ignore_case)) {
+				all.push_back(i);
+				i += size - 1;
+			}
+		}
+		expect(buffer.find_all(needle.data(), size, ignore_case) == all, "find_all");
+	}
+}
+static void check_brackets(const TextBuffer& buffer, const std::string& model) {
+	const std::size_t index = get_random(model.size());
+	std::size_t result, expected;
+	const bool found = buffer.find_matching_bracket(index, result);
+	expect(found == find_matching_bracket(model, index, expected) && (!found || result == expected), "find_matching_bracket");
+	// the innermost pair of any kind around index
+	bool found_enclosing = false;
+	std::size_t open = 0, close = 0;
+	for (std::size_t kind = 0; kind < 3; ++kind) {
+		std::size_t kind_open, kind_close;
+		if (find_bracket(model, index, kind, false, kind_open) && (!found_enclosing || kind_open > open) && find_bracket(model, index, kind, true, kind_close)) {
+			open = kind_open;
+			close = kind_close;
+			found_enclosing = true;
+		}
+	}
+	std::size_t result_open, result_close;
+	const bool found_result = buffer.find_enclosing_brackets(index, result_open, result_close);
+	expect(found_result == found_enclosing && (!found_result || (result_open == open && result_close == close)), "find_enclosing_brackets");
+}
+static void check_chunks(const TextBuffer& buffer, const std::string& model) {
+	// every chunk a reader got since get_chunk stays valid while it reads on, also if it was decompressed
+	if (model.empty()) {
+		return;
+	}
+	const std::size_t index = rng() % model.size();
+	const std::pair<Input::Chunk, std::size_t> first = buffer.get_chunk(index);
+	expect(first.second <= index && index < first.second + first.first.size, "get_chunk");
+	std::vector<Input::Chunk> chunks;
+	for (Input::Chunk chunk = first.first; chunk.size > 0; chunk = buffer.get_next_chunk(chunk.chunk)) {
+		chunks.push_back(chunk);
+	}
+	std::string contents;
+	for (const Input::Chunk& chunk: chunks) {
+		contents.append(chunk.data, chunk.size);
+	}
+	expect(contents == model.substr(first.second), "get_next_chunk");
+}
+static void check_save(const TextBuffer& buffer, const std::string& model) {
+	const char* path = "tree_fuzz.tmp";
+	expect(buffer.save(path), "save");
+	expect(read_file(path) == model, "save");
+	// loading adds a final newline
+	const TextBuffer loaded(path, 1 + rng() % 2);
+	expect(std::string(loaded.begin(), loaded.end()) == (model.empty() || model.back() != '\n' ? model + '\n' : model), "load");
+	std::remove(path);
+}
+static void check_buffer(const TextBuffer& buffer, const std::string& model, bool contents) {
+	expect(buffer.get_info() == get_fold<Info>(model.data(), model.size()), "get_info");
+	const std::size_t index = get_random(model.size());
+	expect(buffer.get_info_for_index(index) == get_fold<Info>(model.data(), index), "get_info_for_index");
+	const std::size_t line = get_random(buffer.get_total_lines() + 1);
+	const std::size_t utf16_column = get_random(rng() % 4 == 0 ? 1000 : 20);
+	expect(buffer.get_info_for_line_utf16(line, utf16_column).bytes == get_utf16_position(model, line, utf16_column), "get_info_for_line_utf16");
+	const std::size_t index1 = std::min(model.size(), index + get_random_length());
+	std::string range;
+	buffer.append_range(range, index, index1);
+	expect(range == model.substr(index, index1 - index), "append_range");
+	check_search(buffer, model);
+	check_brackets(buffer, model);
+	if (rng() % 8 == 0) {
+		expect((buffer.get_utf8_errors() == 0) == (get_repaired(model) == model), "get_utf8_errors");
+		check_chunks(buffer, model);
+	}
+	if (contents) {
+		expect(std::string(buffer.begin(), buffer.end()) == model, "contents");
+		check_save(buffer, model);
+	}
+}
+static void apply_buffer(TextBuffer& buffer, std::string& model) {
+	switch (rng() % 12) {
+	case 0: {
+		operation = "buffer insert";
+		const std::size_t index = get_random(model.size());
+		const char c = get_random_string(1)[0];
+		buffer.insert(index, c);
+		model.insert(model.begin() + index, c);
+		break;
+	}
+	case 1:
+	case 2: {
+		operation = "buffer insert range";
+		const std::size_t index = get_random(model.size());
+		const std::string text = get_random_string(get_random_length());
+		buffer.insert(index, text.data(), text.size());
+		model.insert(index, text);
+		break;
+	}
+	case 3: {
+		operation = "buffer remove";
+		if (model.empty()) {
+			break;
+		}
+		const std::size_t index = rng() % model.size();
+		buffer.remove(index);
+		model.erase(index, 1);
+		break;
+	}
+	case 4:
+	case 5: {
+		operation = "buffer remove range";
+		const std::size_t index0 = get_random(model.size());
+		const std::size_t index1 = std::min(model.size(), index0 + get_random_length());
+		buffer.remove(index0, index1);
+		model.erase(index0, index1 - index0);
+		break;
+	}
+	case 6: {
+		operation = "cut";
+		const std::size_t index0 = get_random(model.size());
+		const std::size_t index1 = std::min(model.size(), index0 + get_random_length());
+		expect(buffer.cut(index0, index1) == model.substr(index0, index1 - index0), "cut");
+		model.erase(index0, index1 - index0);
+		break;
+	}
+	case 7: {
+		operation = "move_block";
+		const std::size_t index0 = get_random(model.size());
+		const std::size_t index1 = std::min(model.size(), index0 + get_random_length());
+		const std::size_t index = rng() % 2 ? get_random(index0) : index1 + get_random(model.size() - index1);
+		buffer.move_block(index0, index1, index);
+		const std::string block = model.substr(index0, index1 - index0);
+		model.erase(index0, index1 - index0);
+		model.insert(index > index0 ? index - block.size() : index, block);
+		break;
+	}
+	case 8: {
+		operation = "buffer compress";
+		buffer.compress(get_random(2));
+		break;
+	}
+	case 9: {
+		operation = "buffer compact";
+		if (rng() % 2) {
+			buffer.compact();
+		}
+		else {
+			const std::size_t index = get_random(model.size());
+			expect(buffer.compact(index, get_random_length()) <= model.size(), "compact");
+		}
+		break;
+	}
+	case 10: {
+		operation = "repair_utf8";
+		if (rng() % 4 == 0) {
+			buffer.repair_utf8();
+			model = get_repaired(model);
+		}
+		break;
+	}
+	case 11: {
+		// edits of a snapshot must not be visible in the buffer
+		operation = "snapshot";
+		TextBuffer snapshot = buffer.snapshot();
+		std::string snapshot_model = model;
+		for (std::size_t i = 0; i < 4; ++i) {
+			apply_buffer(snapshot, snapshot_model);
+		}
+		operation = "snapshot";
+		check_buffer(snapshot, snapshot_model, false);
+		break;
+	}
+	}
+}
+static void run_buffer(std::size_t max_size, std::size_t seed, std::size_t iterations) {
+	rng.seed(seed);
+	operation = "create";
+	std::string model = get_random_string(get_random(max_size / 2));
+	TextBuffer buffer;
+	buffer.remove(0, buffer.get_size());
+	buffer.insert(0, model.data(), model.size());
+	check_buffer(buffer, model, true);
+	for (iteration = 0; iteration < iterations; ++iteration) {
+		apply_buffer(buffer, model);
+		if (model.size() > max_size) {
+			operation = "buffer shrink";
+			const std::size_t index = get_random(model.size() - max_size / 2);
+			buffer.remove(index, index + max_size / 2);
+			model.erase(index, max_size / 2);
+		}
+		check_buffer(buffer, model, iteration % CONTENTS_INTERVAL == 0);
+	}
+	check_buffer(buffer, model, true);
+	std::printf("buffer, seed %zu: %zu iterations passed\n", seed, iterations);
+}
+
+int main(int argc, char** argv) {
+	const std::size_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+	const std::size_t iterations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2000;
+	run<Info, ByteComp>("text", 1 << 18, seed, iterations);
+	run<SumInfo, CountComp>("sums", 1 << 16, seed, iterations);
+	run_buffer(1 << 17, seed, iterations);
+}